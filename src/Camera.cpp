@@ -1,10 +1,12 @@
 #include "Camera.hpp"
 
+#include <cmath>
+
 Camera::Camera() {
 }
 
 Camera::Camera(Vec3 eye, Vec3 target, Vec3 up, float fovy, float ar)
-    : position_(eye), aspect_ratio_(ar) {
+    : position_(eye), up_(up), aspect_ratio_(ar) {
     frame_[2] = (eye - target).normalized();
     frame_[0] = cross(up, frame_[2]).normalized();
     frame_[1] = cross(frame_[2], frame_[0]);
@@ -21,6 +23,33 @@ Ray Camera::get_ray(Vec2 sample) const {
                d);
 }
 
+void Camera::move(const Vec3& offset) {
+    position_ += offset[0] * frame_[0] + offset[1] * frame_[1] + offset[2] * frame_[2];
+}
+
+// Rotation of v by angle radians around a unit axis (Rodrigues' formula)
+static Vec3 rotated(const Vec3& v, const Vec3& axis, float angle) {
+    float c = std::cos(angle);
+    float s = std::sin(angle);
+    return c * v + s * cross(axis, v) + (1.0f - c) * dot(axis, v) * axis;
+}
+
+void Camera::turn(float yaw, float pitch) {
+    static const float max_elevation = 0.99f;
+    
+    Vec3 up = up_.normalized();
+    Vec3 back = rotated(frame_[2], up, yaw);
+    
+    Vec3 pitched = rotated(back, cross(up, back).normalized(), pitch);
+    if (std::abs(dot(pitched, up)) < max_elevation) {
+	back = pitched;
+    }
+
+    frame_[2] = back.normalized();
+    frame_[0] = cross(up_, frame_[2]).normalized();
+    frame_[1] = cross(frame_[2], frame_[0]);
+}
+
 const Vec3& Camera::position() const {
     return position_;
 }
@@ -6,7 +6,10 @@
 class Camera {
 private:
     Vec3 position_;
+    // right, up and backwards directions
     Vec3 frame_[3];
+    // up direction of the world
+    Vec3 up_;
     float aspect_ratio_;
     float depth_;
 
@@ -15,5 +18,12 @@ public:
     Camera(Vec3 eye, Vec3 target, Vec3 up, float fovy, float ar);
     Ray get_ray(Vec2 sample) const;
 
+    // Moves the camera by offset, given along its right, up and backwards
+    // directions
+    void move(const Vec3& offset);
+    // Turns the camera left by yaw radians, and up by pitch radians ; the
+    // camera can't look straight up or down
+    void turn(float yaw, float pitch);
+
     const Vec3& position() const;
 };
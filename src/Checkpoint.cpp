@@ -0,0 +1,150 @@
+#include "Checkpoint.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "util.hpp"
+
+static const char checkpoint_magic[8] = {'R', 'C', 'H', 'E', 'C', 'K', 'P', '3'};
+static const char partial_film_magic[8] = {'P', 'A', 'R', 'T', 'F', 'L', 'M', '2'};
+
+static void write_light_paths(std::ostream& out, const std::vector<std::string>& light_paths) {
+    write_raw<uint32_t>(out, light_paths.size());
+    for (const std::string& light_path : light_paths) {
+	write_raw<uint32_t>(out, light_path.size());
+	out.write(light_path.data(), light_path.size());
+    }
+}
+
+static std::vector<std::string> read_light_paths(std::istream& in) {
+    std::vector<std::string> light_paths(read_raw<uint32_t>(in));
+    for (std::string& light_path : light_paths) {
+	light_path.resize(read_raw<uint32_t>(in));
+	read_raw(in, &light_path[0], light_path.size());
+    }
+    return light_paths;
+}
+
+void write_checkpoint(std::ostream& out, const Checkpoint& checkpoint,
+		      const RGBFilm& film, const PathRadianceStore* path_store) {
+    out.write(checkpoint_magic, sizeof(checkpoint_magic));
+    write_raw<uint32_t>(out, checkpoint.seed);
+    write_raw<uint64_t>(out, checkpoint.tile_size);
+    write_raw<uint64_t>(out, checkpoint.tile_samples);
+    write_raw<uint64_t>(out, checkpoint.first_sample);
+    write_light_paths(out, checkpoint.light_paths);
+
+    write_raw<uint32_t>(out, checkpoint.scene_file.size());
+    out.write(checkpoint.scene_file.data(), checkpoint.scene_file.size());
+    write_raw<uint64_t>(out, checkpoint.max_bounces);
+    write_raw<uint64_t>(out, checkpoint.regions.size());
+    for (const Tile& region : checkpoint.regions) {
+	write_raw<uint64_t>(out, region.rowmin);
+	write_raw<uint64_t>(out, region.rowmax);
+	write_raw<uint64_t>(out, region.colmin);
+	write_raw<uint64_t>(out, region.colmax);
+    }
+    write_raw<uint32_t>(out, checkpoint.filter_type);
+    write_raw<float>(out, checkpoint.filter_radius);
+
+    write_raw<uint64_t>(out, checkpoint.tile_passes.size());
+    for (size_t passes : checkpoint.tile_passes) {
+	write_raw<uint64_t>(out, passes);
+    }
+
+    film.write(out);
+
+    write_raw<uint8_t>(out, path_store != nullptr);
+    if (path_store) {
+	path_store->write(out);
+    }
+}
+
+void save_checkpoint(const std::string& path, const Checkpoint& checkpoint,
+		     const RGBFilm& film, const PathRadianceStore* path_store) {
+    std::string temporary_path = path + ".tmp";
+    {
+	std::ofstream out(temporary_path, std::ios::binary);
+	write_checkpoint(out, checkpoint, film, path_store);
+	if (!out) {
+	    throw std::runtime_error("Could not write " + temporary_path);
+	}
+    }
+
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+	throw std::runtime_error("Could not write " + path);
+    }
+}
+
+Checkpoint read_checkpoint(std::istream& in, RGBFilm& film, PathRadianceStore*& path_store) {
+    char magic[sizeof(checkpoint_magic)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0) {
+	throw std::runtime_error("Not a checkpoint file");
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.seed = read_raw<uint32_t>(in);
+    checkpoint.tile_size = read_raw<uint64_t>(in);
+    checkpoint.tile_samples = read_raw<uint64_t>(in);
+    checkpoint.first_sample = read_raw<uint64_t>(in);
+    checkpoint.light_paths = read_light_paths(in);
+
+    checkpoint.scene_file.resize(read_raw<uint32_t>(in));
+    read_raw(in, &checkpoint.scene_file[0], checkpoint.scene_file.size());
+    checkpoint.max_bounces = read_raw<uint64_t>(in);
+    checkpoint.regions.resize(read_raw<uint64_t>(in));
+    for (Tile& region : checkpoint.regions) {
+	region.rowmin = read_raw<uint64_t>(in);
+	region.rowmax = read_raw<uint64_t>(in);
+	region.colmin = read_raw<uint64_t>(in);
+	region.colmax = read_raw<uint64_t>(in);
+    }
+    checkpoint.filter_type = static_cast<FilterType>(read_raw<uint32_t>(in));
+    checkpoint.filter_radius = read_raw<float>(in);
+
+    checkpoint.tile_passes.resize(read_raw<uint64_t>(in));
+    for (size_t& passes : checkpoint.tile_passes) {
+	passes = read_raw<uint64_t>(in);
+    }
+
+    film = RGBFilm(in);
+
+    path_store = nullptr;
+    if (read_raw<uint8_t>(in)) {
+	path_store = new PathRadianceStore(in);
+    }
+
+    return checkpoint;
+}
+
+void write_partial_film(std::ostream& out, const PartialFilmInfo& info, const RGBFilm& film) {
+    out.write(partial_film_magic, sizeof(partial_film_magic));
+    write_raw<uint32_t>(out, info.seed);
+    write_raw<uint64_t>(out, info.sample_ranges.size());
+    for (const std::pair<size_t, size_t>& range : info.sample_ranges) {
+	write_raw<uint64_t>(out, range.first);
+	write_raw<uint64_t>(out, range.second);
+    }
+    write_light_paths(out, info.light_paths);
+    film.write(out);
+}
+
+RGBFilm read_partial_film(std::istream& in, PartialFilmInfo& info) {
+    char magic[sizeof(partial_film_magic)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, partial_film_magic, sizeof(magic)) != 0) {
+	throw std::runtime_error("Not a partial film file");
+    }
+
+    info.seed = read_raw<uint32_t>(in);
+    info.sample_ranges.resize(read_raw<uint64_t>(in));
+    for (std::pair<size_t, size_t>& range : info.sample_ranges) {
+	range.first = read_raw<uint64_t>(in);
+	range.second = read_raw<uint64_t>(in);
+    }
+    info.light_paths = read_light_paths(in);
+    return RGBFilm(in);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Filter.hpp"
+#include "Image.hpp"
+#include "PathRadianceStore.hpp"
+#include "TileScheduler.hpp"
+
+// Progress of a render, from which it can be resumed : besides the film and
+// the path store, the work items they hold, what the random streams of the
+// remaining items depend on, and the settings the samples were taken with
+struct Checkpoint {
+    unsigned int seed;
+    size_t tile_size;
+    size_t tile_samples;
+    // first sample of the rendered range
+    size_t first_sample;
+    // light paths of the film layers
+    std::vector<std::string> light_paths;
+    std::string scene_file;
+    size_t max_bounces;
+    // rendered regions, none for the whole image
+    std::vector<Tile> regions;
+    FilterType filter_type;
+    float filter_radius;
+    // passes merged to each tile, listed in the order of make_tiles
+    std::vector<size_t> tile_passes;
+};
+
+void write_checkpoint(std::ostream& out, const Checkpoint& checkpoint,
+		      const RGBFilm& film, const PathRadianceStore* path_store);
+
+// Writes to a temporary file first, so that the previous checkpoint is kept
+// if writing is interrupted
+void save_checkpoint(const std::string& path, const Checkpoint& checkpoint,
+		     const RGBFilm& film, const PathRadianceStore* path_store);
+
+// The film of the checkpoint replaces film, and its path store, if any, is
+// returned in path_store. Throws std::runtime_error for invalid files.
+Checkpoint read_checkpoint(std::istream& in, RGBFilm& film, PathRadianceStore*& path_store);
+
+// What the samples of a partial film are : the ranges they were taken in,
+// and the seed of their random streams
+struct PartialFilmInfo {
+    unsigned int seed;
+    // disjoint [first, end) ranges of samples
+    std::vector<std::pair<size_t, size_t>> sample_ranges;
+    // light paths of the film layers
+    std::vector<std::string> light_paths;
+};
+
+// Film of sample ranges, left unnormalized so that the films of disjoint
+// ranges can be merged
+void write_partial_film(std::ostream& out, const PartialFilmInfo& info, const RGBFilm& film);
+// Throws std::runtime_error for invalid files
+RGBFilm read_partial_film(std::istream& in, PartialFilmInfo& info);
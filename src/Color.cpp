@@ -1,6 +1,14 @@
 #include "Color.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 RGBColor::RGBColor() : Vec3() {
 }
@@ -19,6 +27,10 @@ RGBColor RGBColor::from_normal(const Vec3& normal) {
     return RGBColor(.5f * (normal + Vec3(1.0f)));
 }
 
+float RGBColor::luminance() const {
+    return .2126f * (*this)[0] + .7152f * (*this)[1] + .0722f * (*this)[2];
+}
+
 void clamp_to_01(float& val) {
     if (val < 0.0f) {
         val = 0.0f;
@@ -49,28 +61,191 @@ float srgb_to_linear(float srgb) {
     }
 }
 
-RGB8 RGBColor::to_8bit() const {
-    float r = (*this)[0];
-    float g = (*this)[1];
-    float b = (*this)[2];
+// 8-bit sRGB code of a linear value
+static uint8_t quantize(float lin) {
+    clamp_to_01(lin);
+    return static_cast<uint8_t>(linear_to_srgb(lin) * 255.0f);
+}
+
+static uint32_t float_bits(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+static float bits_float(uint32_t x) {
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+namespace {
+// Values under 2^-12 all have code 0. Above, the codes are looked up in
+// buckets of the 8 upper mantissa bits of each exponent, which are narrower
+// than the steps of the encoding : the code at the start of the bucket is off
+// by at most one, which a comparison to the next threshold corrects.
+const uint32_t min_encoded_bits = 115u << 23;
+const uint32_t bucket_shift = 15;
+const size_t bucket_count = ((127u << 23) - min_encoded_bits) >> bucket_shift;
+
+struct SRGBTables {
+    // code at the start of each bucket, and of 1
+    uint8_t codes[bucket_count + 1];
+    // smallest linear value of each code, and infinity past the last one
+    float thresholds[257];
+    // linear value of each code
+    float linear[256];
+
+    SRGBTables() {
+	for (size_t i = 0; i <= bucket_count; i++) {
+	    codes[i] = quantize(bits_float(min_encoded_bits + (static_cast<uint32_t>(i) << bucket_shift)));
+	}
+
+	// the positive floats are ordered like their bits
+	thresholds[0] = 0.0f;
+	for (size_t code = 1; code < 256; code++) {
+	    uint32_t low = 0;
+	    uint32_t high = float_bits(1.0f);
+	    while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (quantize(bits_float(middle)) >= code) {
+		    high = middle;
+		} else {
+		    low = middle + 1;
+		}
+	    }
+	    thresholds[code] = bits_float(low);
+	}
+	thresholds[256] = std::numeric_limits<float>::infinity();
+
+	for (size_t code = 0; code < 256; code++) {
+	    linear[code] = srgb_to_linear(code / 255.0f);
+	}
+    }
+};
+
+// Built once, on first use
+const SRGBTables& srgb_tables() {
+    static const SRGBTables tables;
+    return tables;
+}
+}
+
+// Fit of the ACES filmic curve by K. Narkowicz
+static float filmic(float x) {
+    return x * (2.51f * x + 0.03f) / (x * (2.43f * x + 0.59f) + 0.14f);
+}
+
+ToneMapper::ToneMapper(float exposure, Curve curve)
+    : scale_(std::exp2(exposure)), curve_(curve) {
+}
+
+void ToneMapper::encode(const float* channels, size_t count, uint8_t* codes) const {
+    const SRGBTables& tables = srgb_tables();
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps(scale_);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i min_bits = _mm_set1_epi32(min_encoded_bits);
+    const __m128 min_value = _mm_castsi128_ps(min_bits);
+
+    for (; i + 4 <= count; i += 4) {
+	// the maximum is taken with 0 first, which turns NaNs into 0
+	__m128 v = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(channels + i), scale), zero);
+	if (curve_ == FILMIC) {
+	    __m128 numerator = _mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f)));
+	    __m128 denominator = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(2.43f)),
+								      _mm_set1_ps(0.59f))),
+					    _mm_set1_ps(0.14f));
+	    v = _mm_div_ps(numerator, denominator);
+	}
+	v = _mm_max_ps(_mm_min_ps(v, one), min_value);
+	__m128i buckets = _mm_srli_epi32(_mm_sub_epi32(_mm_castps_si128(v), min_bits), bucket_shift);
+
+	alignas(16) float values[4];
+	alignas(16) uint32_t indices[4];
+	_mm_store_ps(values, v);
+	_mm_store_si128(reinterpret_cast<__m128i*>(indices), buckets);
+	for (size_t j = 0; j < 4; j++) {
+	    uint8_t code = tables.codes[indices[j]];
+	    codes[i + j] = code + (values[j] >= tables.thresholds[code + 1]);
+	}
+    }
+#endif
+
+    for (; i < count; i++) {
+	// comparisons ordered as with SSE2 : NaNs become 0, and those of the
+	// filmic curve of infinity become 1
+	float v = channels[i] * scale_;
+	v = v > 0.0f ? v : 0.0f;
+	if (curve_ == FILMIC) {
+	    v = filmic(v);
+	}
+	v = v < 1.0f ? v : 1.0f;
+	v = v > bits_float(min_encoded_bits) ? v : bits_float(min_encoded_bits);
+
+	uint8_t code = tables.codes[(float_bits(v) - min_encoded_bits) >> bucket_shift];
+	codes[i] = code + (v >= tables.thresholds[code + 1]);
+    }
+}
+
+RGB8 ToneMapper::operator()(const RGBColor& color) const {
+    float channels[3] = {color[0], color[1], color[2]};
+    uint8_t codes[3];
+    encode(channels, 3, codes);
+    return {codes[0], codes[1], codes[2]};
+}
+
+// colors are converted by chunks, which keeps the channels in the L1 cache
+static const size_t map_chunk = 256;
+
+void ToneMapper::map(const RGBColor* colors, size_t count, RGB8* rgb8) const {
+    float channels[3 * map_chunk];
+    uint8_t codes[3 * map_chunk];
 
-    clamp_to_01(r);
-    clamp_to_01(g);
-    clamp_to_01(b);
+    for (size_t begin = 0; begin < count; begin += map_chunk) {
+	size_t n = std::min(map_chunk, count - begin);
+	for (size_t i = 0; i < n; i++) {
+	    for (size_t c = 0; c < 3; c++) {
+		channels[3 * i + c] = colors[begin + i][c];
+	    }
+	}
+	encode(channels, 3 * n, codes);
+	for (size_t i = 0; i < n; i++) {
+	    rgb8[begin + i] = {codes[3 * i], codes[3 * i + 1], codes[3 * i + 2]};
+	}
+    }
+}
+
+void ToneMapper::map_packed(const RGBColor* colors, size_t count, uint32_t* packed) const {
+    RGB8 rgb8[map_chunk];
 
-    r = linear_to_srgb(r);
-    g = linear_to_srgb(g);
-    b = linear_to_srgb(b);
+    for (size_t begin = 0; begin < count; begin += map_chunk) {
+	size_t n = std::min(map_chunk, count - begin);
+	map(colors + begin, n, rgb8);
+	for (size_t i = 0; i < n; i++) {
+	    packed[begin + i] = rgb8[i].packed();
+	}
+    }
+}
 
-    if (std::isnan(r) || std::isnan(g) || std::isnan(b)) {
+ToneMapper::Curve parse_tone_curve(const std::string& name) {
+    if (name == "clamp") {
+	return ToneMapper::CLAMP;
+    } else if (name == "filmic") {
+	return ToneMapper::FILMIC;
+    }
+    throw std::invalid_argument("Unknown tone curve " + name);
+}
+
+RGB8 RGBColor::to_8bit() const {
+    if (std::isnan((*this)[0]) || std::isnan((*this)[1]) || std::isnan((*this)[2])) {
         std::cerr << "NAN in to_8bit\n";
     }
 
-    return {
-        static_cast<uint8_t>(r * 255.0f),
-        static_cast<uint8_t>(g * 255.0f),
-        static_cast<uint8_t>(b * 255.0f)
-    };
+    return ToneMapper()(*this);
 }
     
 const RGBColor& RGBColor::operator*=(const RGBColor& rhs) {
@@ -85,16 +260,97 @@ RGBColor operator*(const RGBColor& lhs, const RGBColor& rhs) {
     return result *= rhs;
 }
 
-RGBColor srgb_to_linear(const RGB8& rgb8) {
-    RGBColor result(
-	static_cast<float>(rgb8.r) / 255.0f,
-	static_cast<float>(rgb8.g) / 255.0f,
-	static_cast<float>(rgb8.b) / 255.0f
-	);
+// Rounds to the nearest even half, or stochastically with the random bits of
+// dither if given : up with the probability that makes the rounding unbiased
+static uint16_t float_to_half(float f, const uint32_t* dither = nullptr) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7fffffff;
 
-    for (size_t i = 0; i < 3; i++) {
-	result[i] = srgb_to_linear(result[i]);
+    if (abs > 0x7f800000) {
+	// NaN
+	return sign | 0x7e00;
+    } else if (abs >= 0x477ff000) {
+	// would round to infinity
+	return sign | 0x7bff;
+    } else if (abs < 0x33000000) {
+	// rounds to 0, stochastic rounding included : under 2^-25
+	return sign;
+    }
+
+    uint32_t h, remainder, shift;
+    if (abs < 0x38800000) {
+	// subnormal half : units of 2^-24
+	uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+	shift = 126 - (abs >> 23);
+	h = mantissa >> shift;
+	remainder = mantissa & ((1u << shift) - 1);
+    } else {
+	// exponent rebiased from 127 to 15
+	shift = 13;
+	h = (abs - 0x38000000) >> shift;
+	remainder = abs & 0x1fff;
     }
 
-    return result;
+    uint32_t halfway = 1u << (shift - 1);
+    if (dither) {
+	// carries with the probability remainder / 2^shift, and saturates too
+	h += (remainder + (*dither >> (32 - shift))) >> shift;
+	h = std::min<uint32_t>(h, 0x7bff);
+    } else if (remainder > halfway || (remainder == halfway && (h & 1))) {
+	h++;
+    }
+    return sign | h;
+}
+
+static float half_to_float(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0) {
+	float f = mantissa * (1.0f / 16777216.0f);
+	return sign ? -f : f;
+    }
+
+    uint32_t x = sign | (mantissa << 13);
+    x |= exponent == 0x1f ? 0x7f800000 : (exponent + 112) << 23;
+
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+RGBHalf::RGBHalf() : r(0), g(0), b(0) {
+}
+
+RGBHalf::RGBHalf(const RGBColor& color)
+    : r(float_to_half(color[0])), g(float_to_half(color[1])), b(float_to_half(color[2])) {
+}
+
+RGBHalf RGBHalf::round_stochastic(const RGBColor& color, uint64_t random) {
+    uint32_t dither[3] = {static_cast<uint32_t>(random), static_cast<uint32_t>(random >> 32),
+			  static_cast<uint32_t>((random * 0x9e3779b97f4a7c15ull) >> 32)};
+    RGBHalf h;
+    h.r = float_to_half(color[0], &dither[0]);
+    h.g = float_to_half(color[1], &dither[1]);
+    h.b = float_to_half(color[2], &dither[2]);
+    return h;
+}
+
+RGBColor RGBHalf::to_float() const {
+    return RGBColor(half_to_float(r), half_to_float(g), half_to_float(b));
+}
+
+RGBColor srgb_to_linear(const RGB8& rgb8) {
+    const float* linear = srgb_tables().linear;
+    return RGBColor(linear[rgb8.r], linear[rgb8.g], linear[rgb8.b]);
+}
+
+void srgb_to_linear(const RGB8* rgb8, size_t count, RGBColor* colors) {
+    const float* linear = srgb_tables().linear;
+    for (size_t i = 0; i < count; i++) {
+	colors[i] = RGBColor(linear[rgb8[i].r], linear[rgb8[i].g], linear[rgb8[i].b]);
+    }
 }
@@ -1,11 +1,19 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 #include "Vec.hpp"
 
 struct RGB8 {
     uint8_t r;
     uint8_t g;
     uint8_t b;
+
+    // as 0x00RRGGBB
+    uint32_t packed() const {
+	return (static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | b;
+    }
 };
 
 class RGBColor : public Vec3 {
@@ -21,9 +29,54 @@ public:
     
     const RGBColor& operator*=(const RGBColor& other);
 
+    // Rec. 709 luminance of a linear color
+    float luminance() const;
+
     RGB8 to_8bit() const;
 };
 
 RGBColor operator*(const RGBColor& lhs, const RGBColor& rhs);
 
+// Color stored as three half-precision floats, as in OpenEXR images
+struct RGBHalf {
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+
+    RGBHalf();
+    // Rounds to the nearest halves, saturating at the largest finite one
+    explicit RGBHalf(const RGBColor& color);
+    // Rounds each channel up or down at random, so that on average the halves
+    // equal the color : the 64 bits of random pick the roundings
+    static RGBHalf round_stochastic(const RGBColor& color, uint64_t random);
+
+    RGBColor to_float() const;
+};
+
+// Maps linear colors to 8-bit sRGB : scales them by 2^exposure, compresses
+// them with the tone curve, then encodes them through lookup tables.
+// With the defaults, gives the same codes as RGBColor::to_8bit.
+class ToneMapper {
+public:
+    enum Curve { CLAMP, FILMIC };
+
+    explicit ToneMapper(float exposure = 0.0f, Curve curve = CLAMP);
+
+    RGB8 operator()(const RGBColor& color) const;
+    // Batches of colors, whose channels are mapped 4 at a time with SSE2
+    void map(const RGBColor* colors, size_t count, RGB8* rgb8) const;
+    // As 0x00RRGGBB
+    void map_packed(const RGBColor* colors, size_t count, uint32_t* packed) const;
+
+private:
+    float scale_;
+    Curve curve_;
+
+    void encode(const float* channels, size_t count, uint8_t* codes) const;
+};
+
+// Throws std::invalid_argument for unknown names
+ToneMapper::Curve parse_tone_curve(const std::string& name);
+
 RGBColor srgb_to_linear(const RGB8& rgb8);
+void srgb_to_linear(const RGB8* rgb8, size_t count, RGBColor* colors);
@@ -0,0 +1,118 @@
+#include "Filter.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+const size_t Filter::table_size;
+const size_t Filter::max_radius;
+const size_t Filter::max_footprint_width;
+
+static const char* filter_names[] = {
+    "box", "triangle", "gaussian", "mitchell", "blackman-harris", "lanczos"
+};
+
+FilterType parse_filter_type(const std::string& name) {
+    for (size_t i = 0; i < sizeof(filter_names) / sizeof(filter_names[0]); i++) {
+	if (name == filter_names[i]) {
+	    return static_cast<FilterType>(i);
+	}
+    }
+
+    throw std::invalid_argument("Unknown filter " + name);
+}
+
+std::string filter_type_name(FilterType type) {
+    return filter_names[type];
+}
+
+static float mitchell_1d(float x) {
+    float B = 1.0f / 3.0f;
+    float C = 1.0f / 3.0f;
+
+    x = std::abs(2 * x);
+    if (x > 1)
+        return ((-B - 6*C) * x*x*x + (6*B + 30*C) * x*x +
+                (-12*B - 48*C) * x + (8*B + 24*C)) * (1.f/6.f);
+    else
+        return ((12 - 9*B - 6*C) * x*x*x +
+                (-18 + 12*B + 6*C) * x*x +
+                (6 - 2*B)) * (1.f/6.f);
+}
+
+static float sinc(float x) {
+    if (std::abs(x) < 1e-5f) {
+	return 1.0f;
+    }
+    return std::sin(M_PI * x) / (M_PI * x);
+}
+
+// 1D filter at a distance d <= radius from the sample, in pixels
+static float evaluate_filter(FilterType type, float d, float radius) {
+    float u = d / radius;
+
+    switch (type) {
+    case BOX:
+	return 1.0f;
+    case TRIANGLE:
+	return 1.0f - u;
+    case GAUSSIAN: {
+	const float alpha = 2.0f;
+	return std::exp(-alpha * d * d) - std::exp(-alpha * radius * radius);
+    }
+    case MITCHELL:
+	return mitchell_1d(u);
+    case BLACKMAN_HARRIS:
+	return 0.35875f + 0.48829f * std::cos(M_PI * u)
+	    + 0.14128f * std::cos(2 * M_PI * u) + 0.01168f * std::cos(3 * M_PI * u);
+    case LANCZOS:
+	return sinc(d) * sinc(u);
+    }
+
+    return 0.0f;
+}
+
+Filter::Filter(FilterType type, float radius)
+    : type_(type), radius_(radius), table_(table_size) {
+    if (!(radius > 0.0f && radius <= max_radius)) {
+	throw std::invalid_argument("Filter radius must be in (0, 16]");
+    }
+
+    table_scale_ = (table_size - 1) / radius;
+
+    // dividing by the radius keeps the integral of the 2D filter independent of it
+    for (size_t i = 0; i < table_size; i++) {
+	table_[i] = evaluate_filter(type, i / table_scale_, radius) / radius;
+    }
+}
+
+FilterFootprint Filter::footprint(const Vec2& pos, size_t width, size_t height) const {
+    FilterFootprint fp;
+
+    fp.colmin = static_cast<size_t>(std::floor(pos[0] + .5f - radius_));
+    fp.colmax = static_cast<size_t>(std::ceil(pos[0] - 1.5f + radius_));
+
+    fp.rowmin = static_cast<size_t>(std::floor(pos[1] + .5f - radius_));
+    fp.rowmax = static_cast<size_t>(std::ceil(pos[1] - 1.5f + radius_));
+
+    if (fp.colmin >= width) {
+    	fp.colmin = 0;
+    }
+    if (fp.colmax >= width) {
+    	fp.colmax = width - 1;
+    }
+
+    if (fp.rowmin >= height) {
+    	fp.rowmin = 0;
+    }
+    if (fp.rowmax >= height) {
+    	fp.rowmax = height - 1;
+    }
+
+    return fp;
+}
+
+void Filter::weights(float pos, size_t min, size_t max, float* weights) const {
+    for (size_t i = min; i <= max; i++) {
+	weights[i - min] = evaluate(pos - (i + .5f));
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "Vec.hpp"
+
+enum FilterType { BOX, TRIANGLE, GAUSSIAN, MITCHELL, BLACKMAN_HARRIS, LANCZOS };
+
+// Throws std::invalid_argument for unknown names
+FilterType parse_filter_type(const std::string& name);
+std::string filter_type_name(FilterType type);
+
+// Range of pixels covered by the reconstruction filter of an image sample
+struct FilterFootprint {
+    size_t rowmin;
+    size_t rowmax;
+    size_t colmin;
+    size_t colmax;
+};
+
+// Separable reconstruction filter : the weight of a pixel is the product of
+// the 1D filter along each axis, which is tabulated at construction
+class Filter {
+private:
+    FilterType type_;
+    float radius_;
+    // 1D filter at distances i * radius / (table_size - 1) from the sample
+    std::vector<float> table_;
+    float table_scale_;
+
+public:
+    static const size_t table_size = 256;
+    // keeps the weights of a footprint on the stack
+    static const size_t max_radius = 16;
+    static const size_t max_footprint_width = 2 * max_radius + 2;
+
+    Filter(FilterType type=MITCHELL, float radius=1.5f);
+
+    // 1D filter at a distance d from the sample, in pixels
+    float evaluate(float d) const {
+	float x = std::abs(d) * table_scale_;
+	size_t i = static_cast<size_t>(x);
+	if (i >= table_size - 1) {
+	    return 0.0f;
+	}
+	float t = x - i;
+	return table_[i] + t * (table_[i + 1] - table_[i]);
+    }
+
+    FilterFootprint footprint(const Vec2& pos, size_t width, size_t height) const;
+
+    // 1D weights of the pixels min..max along one axis, for a sample at pos
+    void weights(float pos, size_t min, size_t max, float* weights) const;
+
+    FilterType type() const { return type_; }
+    float radius() const { return radius_; }
+};
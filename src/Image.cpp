@@ -1,7 +1,20 @@
 #include "Image.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
 #include <stdexcept>
 
+#include "ThreadPool.hpp"
+#include "util.hpp"
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
 #pragma GCC diagnostic ignored "-Wsign-compare"
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
@@ -14,128 +27,428 @@
 
 #pragma GCC diagnostic pop
 
-RGBFilm::RGBFilm(size_t width, size_t height, float filter_radius)
-    : colors_(height, width), weights_(height, width), filter_radius_(filter_radius) {
+RGBFilm::RGBFilm(size_t width, size_t height, size_t layer_count, const Filter& filter, bool compact)
+    : RGBFilm(width, height, 0, height, layer_count, filter, compact) {
 }
 
-Buffer2D<RGB8> to_rgb8(const Buffer2D<RGBColor>& color) {
-    Buffer2D<RGB8> img(color.rows(), color.columns());
+RGBFilm::RGBFilm(size_t width, size_t height, size_t first_row, size_t rows,
+		 size_t layer_count, const Filter& filter, bool compact)
+    : layer_count_(layer_count), compact_(compact), first_row_(first_row), image_height_(height),
+      colors_(compact ? 0 : rows, width * layer_count), means_(compact ? rows : 0, width * layer_count),
+      weights_(rows, width), stats_(compact ? 0 : rows, compact ? 0 : width), filter_(filter) {
+}
+
+static const char film_magic[8] = {'R', 'G', 'B', 'F', 'I', 'L', 'M', '4'};
+
+static_assert(sizeof(RGBColor) == 3 * sizeof(float), "RGBColor is written as 3 floats");
+static_assert(sizeof(RGBHalf) == 3 * sizeof(uint16_t), "RGBHalf is written as 3 halves");
+static_assert(sizeof(PixelStats) == 3 * sizeof(float), "PixelStats is written as 3 floats");
+
+RGBFilm::RGBFilm(std::istream& in)
+    : first_row_(0), colors_(0, 0), means_(0, 0), weights_(0, 0), stats_(0, 0) {
+    char magic[sizeof(film_magic)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, film_magic, sizeof(magic)) != 0) {
+	throw std::runtime_error("Not a film file");
+    }
+
+    size_t width = read_raw<uint64_t>(in);
+    size_t height = read_raw<uint64_t>(in);
+    image_height_ = height;
+    layer_count_ = read_raw<uint64_t>(in);
+    FilterType filter_type = static_cast<FilterType>(read_raw<uint32_t>(in));
+    float filter_radius = read_raw<float>(in);
+    filter_ = Filter(filter_type, filter_radius);
+    compact_ = read_raw<uint8_t>(in);
+
+    if (compact_) {
+	means_ = Buffer2D<RGBHalf>(height, width * layer_count_);
+    } else {
+	colors_ = Buffer2D<RGBColor>(height, width * layer_count_);
+	stats_ = Buffer2D<PixelStats>(height, width);
+    }
+    weights_ = Buffer2D<float>(height, width);
+
+    read_raw(in, colors_.data(), colors_.rows() * colors_.columns());
+    read_raw(in, means_.data(), means_.rows() * means_.columns());
+    read_raw(in, weights_.data(), weights_.rows() * weights_.columns());
+    read_raw(in, stats_.data(), stats_.rows() * stats_.columns());
+}
+
+void RGBFilm::write(std::ostream& out) const {
+    out.write(film_magic, sizeof(film_magic));
+    // the rows held only
+    write_raw<uint64_t>(out, width());
+    write_raw<uint64_t>(out, row_count());
+    write_raw<uint64_t>(out, layer_count_);
+    write_raw<uint32_t>(out, filter_.type());
+    write_raw<float>(out, filter_.radius());
+    write_raw<uint8_t>(out, compact_);
+
+    // sums and statistics, or means for compact films : the others are empty
+    write_raw(out, colors_.data(), colors_.rows() * colors_.columns());
+    write_raw(out, means_.data(), means_.rows() * means_.columns());
+    write_raw(out, weights_.data(), weights_.rows() * weights_.columns());
+    write_raw(out, stats_.data(), stats_.rows() * stats_.columns());
+}
+
+PixelStats::PixelStats()
+    : count(0.0f), mean(0.0f), m2(0.0f) {
+}
+
+// Welford's online update
+void PixelStats::add(float x) {
+    count += 1.0f;
+    float delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+
+// Chan et al.'s pairwise combination
+void PixelStats::merge(const PixelStats& other) {
+    if (other.count == 0.0f) {
+	return;
+    }
     
-    for (size_t row = 0; row < color.rows(); row++) {
-	for (size_t col = 0; col < color.columns(); col++) {
-	    img(row, col) = color(row, col).to_8bit();
-	}
+    float total = count + other.count;
+    float delta = other.mean - mean;
+    
+    mean += delta * other.count / total;
+    m2 += other.m2 + delta * delta * count * other.count / total;
+    count = total;
+}
+
+float PixelStats::relative_error() const {
+    static const float min_luminance = 0.01f;
+    
+    if (count < 2.0f) {
+	return std::numeric_limits<float>::infinity();
     }
 
+    float variance = m2 / (count - 1.0f);
+    return std::sqrt(variance / count) / std::max(mean, min_luminance);
+}
+
+Buffer2D<RGB8> to_rgb8(const Buffer2D<RGBColor>& color, const ToneMapper& tone) {
+    Buffer2D<RGB8> img(color.rows(), color.columns());
+    tone.map(color.data(), color.rows() * color.columns(), img.data());
     return img;
 }
 
 Buffer2D<RGBColor> to_rgbcolor(const Buffer2D<RGB8>& color) {
     Buffer2D<RGBColor> img(color.rows(), color.columns());
+    srgb_to_linear(color.data(), color.rows() * color.columns(), img.data());
+    return img;
+}
+
+// clamp samples carrying too much light
+// this biases the render, but leads to smoother results
+static RGBColor clamp_firefly(const RGBColor& color) {
+    static const float firefly_threshold = 300.0f;
+    static const float firefly_threshold_squared = firefly_threshold * firefly_threshold;
+
+    if (norm_squared(color) > firefly_threshold_squared) {
+	return firefly_threshold * color.normalized();
+    }
+
+    return color;
+}
+
+// Splats a sample to the pixels of fp, in buffers whose first pixel is the
+// pixel (row0, col0) of the film
+static void splat(Buffer2D<RGBColor>& colors, Buffer2D<float>& weights, size_t row0, size_t col0,
+		  const FilterFootprint& fp, const Vec2& pos, const std::vector<RGBColor>& sample_colors,
+		  const Filter& filter) {
+    size_t layer_count = sample_colors.size();
+    
+    std::vector<RGBColor> clamped(layer_count);
+    for (size_t layer = 0; layer < layer_count; layer++) {
+	clamped[layer] = clamp_firefly(sample_colors[layer]);
+    }
+
+    float row_weights[Filter::max_footprint_width];
+    float col_weights[Filter::max_footprint_width];
+    filter.weights(pos[1], fp.rowmin, fp.rowmax, row_weights);
+    filter.weights(pos[0], fp.colmin, fp.colmax, col_weights);
     
-    for (size_t row = 0; row < color.rows(); row++) {
-	for (size_t col = 0; col < color.columns(); col++) {
-	    img(row, col) = srgb_to_linear(color(row, col));
+    for (size_t row = fp.rowmin; row <= fp.rowmax; row++) {
+	for (size_t col = fp.colmin; col <= fp.colmax; col++) {
+	    float weight = row_weights[row - fp.rowmin] * col_weights[col - fp.colmin];
+
+	    weights(row - row0, col - col0) += weight;
+
+	    RGBColor* pixel = &colors(row - row0, (col - col0) * layer_count);
+	    for (size_t layer = 0; layer < layer_count; layer++) {
+		pixel[layer] += clamped[layer] * weight;
+	    }
 	}
     }
+}
 
-    return img;
+// Luminance recorded in the pixel statistics for a sample
+static float sample_luminance(const std::vector<RGBColor>& colors) {
+    float luminance = 0.0f;
+    for (const RGBColor& color : colors) {
+	luminance += clamp_firefly(color).luminance();
+    }
+    return luminance;
 }
 
-static float mitchell_1d(float x) {
-    float B = 1.0f / 3.0f;
-    float C = 1.0f / 3.0f;
-    
-    x = std::abs(2 * x);
-    if (x > 1)
-        return ((-B - 6*C) * x*x*x + (6*B + 30*C) * x*x +
-                (-12*B - 48*C) * x + (8*B + 24*C)) * (1.f/6.f);
-    else
-        return ((12 - 9*B - 6*C) * x*x*x + 
-                (-18 + 12*B + 6*C) * x*x +
-                (6 - 2*B)) * (1.f/6.f);
+size_t RGBFilm::apron() const {
+    return static_cast<size_t>(std::ceil(filter_.radius()));
 }
 
-static float mitchell_filter(Vec2 u) {
-    return mitchell_1d(u[0]) * mitchell_1d(u[1]);
+RGBFilmTile RGBFilm::make_tile(size_t rowmin, size_t rowmax, size_t colmin, size_t colmax) const {
+    size_t a = apron();
+    
+    size_t row0 = rowmin > a ? rowmin - a : 0;
+    size_t col0 = colmin > a ? colmin - a : 0;
+    size_t row1 = std::min(rowmax + a, height());
+    size_t col1 = std::min(colmax + a, width());
+
+    return RGBFilmTile(row0, col0, row1 - row0, col1 - col0, width(), height(), layer_count_, &filter_,
+		       !compact_);
 }
 
-void RGBFilm::add_sample(size_t row, size_t col, const RGBColor& color, float weight) {
-    weights_(row, col) += weight;
-    colors_(row, col) += color * weight;
+void RGBFilm::merge_tile(const RGBFilmTile& tile) {
+    assert(tile.row0_ >= first_row_ && tile.row0_ + tile.weights_.rows() <= first_row_ + row_count());
+    size_t row0 = tile.row0_ - first_row_;
+
+    for (size_t row = 0; row < tile.weights_.rows(); row++) {
+	for (size_t col = 0; col < tile.stats_.columns(); col++) {
+	    stats_(row0 + row, tile.col0_ + col).merge(tile.stats_(row, col));
+	}
+
+	if (compact_) {
+	    for (size_t col = 0; col < tile.weights_.columns(); col++) {
+		accumulate(row0 + row, tile.col0_ + col, &tile.colors_(row, col * layer_count_),
+			   tile.weights_(row, col));
+	    }
+	    continue;
+	}
+
+	for (size_t col = 0; col < tile.weights_.columns(); col++) {
+	    weights_(row0 + row, tile.col0_ + col) += tile.weights_(row, col);
+	}
+	
+	const RGBColor* src = &tile.colors_(row, 0);
+	RGBColor* dst = &colors_(row0 + row, tile.col0_ * layer_count_);
+	for (size_t i = 0; i < tile.colors_.columns(); i++) {
+	    dst[i] += src[i];
+	}
+    }
 }
 
-void RGBFilm::add_sample(const Vec2& pos, RGBColor color) {
-    static const float firefly_threshold = 300.0f;
-    static const float firefly_threshold_squared = firefly_threshold * firefly_threshold;
+void RGBFilm::merge(const RGBFilm& other) {
+    if (other.width() != width() || other.height() != height() || other.first_row_ != first_row_
+	|| other.row_count() != row_count() || other.layer_count_ != layer_count_) {
+	throw std::invalid_argument("Merged films differ in size or layers");
+    }
+    if (other.filter_.type() != filter_.type() || other.filter_.radius() != filter_.radius()) {
+	throw std::invalid_argument("Merged films differ in filter");
+    }
 
-    RGBColor sample_color = color;
-    
-    // clamp samples carrying too much light
-    // this biases the render, but leads to smoother results
-    if (norm_squared(sample_color) > firefly_threshold_squared) {
-	sample_color = firefly_threshold * sample_color.normalized();
+    // the statistics would only cover part of the samples
+    if (other.compact_ && !compact_) {
+	means_ = Buffer2D<RGBHalf>(row_count(), width() * layer_count_);
+	for (size_t row = 0; row < row_count(); row++) {
+	    for (size_t i = 0; i < means_.columns(); i++) {
+		means_(row, i) = RGBHalf(get_color(row, i / layer_count_, i % layer_count_));
+	    }
+	}
+	compact_ = true;
+	colors_ = Buffer2D<RGBColor>(0, 0);
+	stats_ = Buffer2D<PixelStats>(0, 0);
     }
-    
-    size_t colmin = static_cast<size_t>(std::floor(pos[0] + .5f - filter_radius_));
-    size_t colmax = static_cast<size_t>(std::ceil(pos[0] - 1.5f + filter_radius_));
 
-    size_t rowmin = static_cast<size_t>(std::floor(pos[1] + .5f - filter_radius_));
-    size_t rowmax = static_cast<size_t>(std::ceil(pos[1] - 1.5f + filter_radius_));
+    std::vector<RGBColor> sums(layer_count_);
+    for (size_t row = 0; row < row_count(); row++) {
+	for (size_t col = 0; col < width(); col++) {
+	    float weight = other.weights_(row, col);
+	    size_t first = col * layer_count_;
+	    for (size_t layer = 0; layer < layer_count_; layer++) {
+		sums[layer] = other.compact_ ? RGBColor(other.means_(row, first + layer).to_float() * weight)
+		    : other.colors_(row, first + layer);
+	    }
+
+	    if (compact_) {
+		accumulate(row, col, sums.data(), weight);
+		continue;
+	    }
+	    stats_(row, col).merge(other.stats_(row, col));
+	    weights_(row, col) += weight;
+	    for (size_t layer = 0; layer < layer_count_; layer++) {
+		colors_(row, first + layer) += sums[layer];
+	    }
+	}
+    }
+}
 
-    if (colmin >= width()) {
-    	colmin = 0;
+void RGBFilm::accumulate(size_t row, size_t col, const RGBColor* sums, float weight) {
+    // pixels of the apron the tile didn't reach are left as they are, rather
+    // than rounded again
+    bool empty = weight == 0.0f;
+    for (size_t layer = 0; layer < layer_count_; layer++) {
+	empty = empty && sums[layer][0] == 0.0f && sums[layer][1] == 0.0f && sums[layer][2] == 0.0f;
     }
-    if (colmax >= width()) {
-    	colmax = width() - 1;
+    float& w = weights_(row, col);
+    float total = w + weight;
+    if (empty || total == 0.0f) {
+	return;
     }
-    
-    if (rowmin >= height()) {
-    	rowmin = 0;
+    uint32_t total_bits;
+    std::memcpy(&total_bits, &total, sizeof(total_bits));
+
+    RGBHalf* means = &means_(row, col * layer_count_);
+    for (size_t layer = 0; layer < layer_count_; layer++) {
+	RGBColor mean = (means[layer].to_float() * w + sums[layer]) / total;
+
+	// random bits of the pixel and of the merge, so that films merged in
+	// the same order hold the same means
+	uint64_t z = (((first_row_ + row) * width() + col) * layer_count_ + layer) * 0x9e3779b97f4a7c15ull
+	    + total_bits;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	means[layer] = RGBHalf::round_stochastic(mean, z ^ (z >> 31));
     }
-    if (rowmax >= height()) {
-    	rowmax = height() - 1;
+
+    w = total;
+}
+
+void RGBFilm::clear() {
+    std::fill(colors_.data(), colors_.data() + colors_.rows() * colors_.columns(), RGBColor());
+    std::fill(means_.data(), means_.data() + means_.rows() * means_.columns(), RGBHalf());
+    std::fill(weights_.data(), weights_.data() + weights_.rows() * weights_.columns(), 0.0f);
+    std::fill(stats_.data(), stats_.data() + stats_.rows() * stats_.columns(), PixelStats());
+}
+
+// Moves the rows of a buffer up by shift rows, and empties the last ones
+template<typename T>
+static void shift_rows(Buffer2D<T>& buffer, size_t shift) {
+    shift = std::min(shift, buffer.rows());
+    T* data = buffer.data();
+    T* end = data + buffer.rows() * buffer.columns();
+    T* kept = data + shift * buffer.columns();
+
+    std::copy(kept, end, data);
+    std::fill(end - (kept - data), end, T());
+}
+
+void RGBFilm::advance(size_t first_row) {
+    assert(first_row >= first_row_);
+
+    size_t shift = first_row - first_row_;
+    shift_rows(colors_, shift);
+    shift_rows(means_, shift);
+    shift_rows(weights_, shift);
+    shift_rows(stats_, shift);
+    first_row_ = first_row;
+}
+
+RGBFilmTile::RGBFilmTile(size_t row0, size_t col0, size_t rows, size_t columns,
+			 size_t film_width, size_t film_height, size_t layer_count, const Filter* filter,
+			 bool statistics)
+    : row0_(row0), col0_(col0), film_width_(film_width), film_height_(film_height),
+      layer_count_(layer_count), colors_(rows, columns * layer_count), weights_(rows, columns),
+      stats_(statistics ? rows : 0, statistics ? columns : 0), filter_(filter) {
+}
+
+void RGBFilmTile::add_sample(const Vec2& pos, const std::vector<RGBColor>& colors) {
+    assert(colors.size() == layer_count_);
+
+    size_t row = static_cast<size_t>(pos[1]);
+    size_t col = static_cast<size_t>(pos[0]);
+    if (row >= row0_ && row < row0_ + stats_.rows() && col >= col0_ && col < col0_ + stats_.columns()) {
+	stats_(row - row0_, col - col0_).add(sample_luminance(colors));
     }
     
-    for (size_t row = rowmin; row <= rowmax; row++) {
-	for (size_t col = colmin; col <= colmax; col++) {
-	    Vec2 pixel_center(col + .5f, row + .5f);
+    FilterFootprint fp = filter_->footprint(pos, film_width_, film_height_);
+
+    // the apron covers the footprint of samples taken inside the tile, this
+    // only guards against samples taken outside of it
+    fp.rowmin = std::max(fp.rowmin, row0_);
+    fp.colmin = std::max(fp.colmin, col0_);
+    fp.rowmax = std::min(fp.rowmax, row0_ + weights_.rows() - 1);
+    fp.colmax = std::min(fp.colmax, col0_ + weights_.columns() - 1);
+    
+    splat(colors_, weights_, row0_, col0_, fp, pos, colors, *filter_);
+}
 
-	    Vec2 d = (pos - pixel_center) / filter_radius_;
-	    float weight = mitchell_filter(d) / (filter_radius_ * filter_radius_);
-	    
-	    add_sample(row, col, sample_color, weight);
+const PixelStats& RGBFilm::get_stats(size_t row, size_t col) const {
+    assert(!compact_);
+    return stats_(row - first_row_, col);
+}
+
+Buffer2D<RGB8> RGBFilm::get_sample_count_image() const {
+    assert(!compact_);
+    float max_count = 0.0f;
+    for (size_t row = 0; row < row_count(); row++) {
+	for (size_t col = 0; col < width(); col++) {
+	    max_count = std::max(max_count, stats_(row, col).count);
+	}
+    }
+    
+    Buffer2D<RGB8> image(row_count(), width());
+    
+    for (size_t row = 0; row < row_count(); row++) {
+	for (size_t col = 0; col < width(); col++) {
+	    uint8_t v = max_count > 0.0f ? static_cast<uint8_t>(255.0f * stats_(row, col).count / max_count) : 0;
+	    image(row, col) = RGB8{v, v, v};
 	}
     }
+
+    return image;
 }
 
-RGBColor RGBFilm::get_color(size_t row, size_t col) const {
+RGBColor RGBFilm::get_color(size_t row, size_t col, size_t layer) const {
+    if (compact_) {
+	return means_(row, col * layer_count_ + layer).to_float();
+    }
+
     float w = weights_(row, col);
     if (w == 0.0f) {
 	return RGBColor(0, 0, 0);
     } else {
-	return colors_(row, col) / w;
+	return colors_(row, col * layer_count_ + layer) / w;
     }
 }
 
-Buffer2D<RGB8> RGBFilm::get_image() const {
-    Buffer2D<RGB8> image(height(), width());
+// resolved a row at a time, and tone-mapped by rows
+Buffer2D<RGB8> RGBFilm::get_image(size_t layer, const ToneMapper& tone) const {
+    Buffer2D<RGB8> image(row_count(), width());
+    std::vector<RGBColor> colors(width());
 
-    for (size_t row = 0; row < height(); row++) {
+    for (size_t row = 0; row < row_count(); row++) {
 	for (size_t col = 0; col < width(); col++) {
-	    image(row, col) = get_color(row, col).to_8bit();
+	    colors[col] = get_color(row, col, layer);
 	}
+	tone.map(colors.data(), width(), &image(row, 0));
     }
 
     return image;
 }
 
-Buffer2D<RGBColor> RGBFilm::get_colors() const {
-    Buffer2D<RGBColor> image(height(), width());
+void RGBFilm::get_packed_pixels(size_t layer, size_t rowmin, size_t rowmax, size_t colmin, size_t colmax,
+				Buffer2D<uint32_t>& image, const ToneMapper& tone) const {
+    if (colmin >= colmax) {
+	return;
+    }
+    std::vector<RGBColor> colors(colmax - colmin);
+
+    for (size_t row = rowmin; row < rowmax; row++) {
+	for (size_t col = colmin; col < colmax; col++) {
+	    colors[col - colmin] = get_color(row - first_row_, col, layer);
+	}
+	tone.map_packed(colors.data(), colors.size(), &image(row, colmin));
+    }
+}
+
+Buffer2D<RGBColor> RGBFilm::get_colors(size_t layer) const {
+    Buffer2D<RGBColor> image(row_count(), width());
 
-    for (size_t row = 0; row < height(); row++) {
+    for (size_t row = 0; row < row_count(); row++) {
 	for (size_t col = 0; col < width(); col++) {
-	    image(row, col) = get_color(row, col);
+	    image(row, col) = get_color(row, col, layer);
 	}
     }
 
@@ -158,11 +471,7 @@ void write_ppm(const Buffer2D<RGB8>& colors, std::ostream& out) {
 
 static void stbi_write_callback(void *context, void *data, int size) {
     std::ostream* out = static_cast<std::ostream*>(context);
-    char* data_c = static_cast<char*>(data);
-
-    for (int i = 0; i < size; i++) {
-	*out << data_c[i];
-    }
+    out->write(static_cast<const char*>(data), size);
 }
 
 void write_png(const Buffer2D<RGB8>& colors, std::ostream& out) {
@@ -175,6 +484,306 @@ void write_png(const Buffer2D<RGB8>& colors, std::ostream& out) {
 			   colors.columns() * sizeof(RGB8));
 }
 
+void write_pfm(const Buffer2D<RGBColor>& colors, std::ostream& out) {
+    // a negative scale marks little-endian floats
+    out << "PF\n" << colors.columns() << " " << colors.rows() << "\n-1.0\n";
+
+    // from the bottom row up
+    for (size_t row = colors.rows(); row-- > 0;) {
+	write_raw(out, &colors(row, 0), colors.columns());
+    }
+}
+
+Buffer2D<RGBColor> read_pfm(const std::string& filepath) {
+    std::ifstream in(filepath, std::ios::binary);
+    std::string magic;
+    size_t width = 0, height = 0;
+    float scale = 0.0f;
+    in >> magic >> width >> height >> scale;
+    // a single whitespace character ends the header
+    in.get();
+    if (!in || (magic != "PF" && magic != "Pf") || scale == 0.0f) {
+	throw std::runtime_error("Could not open " + filepath);
+    }
+
+    size_t channels = magic == "PF" ? 3 : 1;
+    std::vector<float> values(width * height * channels);
+    read_raw(in, values.data(), values.size());
+
+    if (scale > 0.0f) {
+	// big-endian
+	for (float& value : values) {
+	    char* bytes = reinterpret_cast<char*>(&value);
+	    std::reverse(bytes, bytes + sizeof(float));
+	}
+    }
+
+    Buffer2D<RGBColor> colors(height, width);
+    for (size_t row = 0; row < height; row++) {
+	const float* src = &values[(height - 1 - row) * width * channels];
+	for (size_t col = 0; col < width; col++) {
+	    const float* pixel = src + col * channels;
+	    colors(row, col) = channels == 3 ? RGBColor(pixel[0], pixel[1], pixel[2]) : RGBColor::gray(pixel[0]);
+	}
+    }
+
+    return colors;
+}
+
+static void write_exr_attribute(std::ostream& out, const std::string& name, const std::string& type,
+				const std::string& value) {
+    out << name << '\0' << type << '\0';
+    write_raw<int32_t>(out, value.size());
+    out << value;
+}
+
+template<typename T>
+static std::string exr_value(const std::vector<T>& fields) {
+    return std::string(reinterpret_cast<const char*>(fields.data()), fields.size() * sizeof(T));
+}
+
+void write_exr(const std::vector<std::string>& layer_names, const std::vector<Buffer2D<RGBColor>>& layers,
+	       ThreadPool& pool, std::ostream& out) {
+    assert(!layers.empty() && layers.size() == layer_names.size());
+    size_t width = layers[0].columns();
+    size_t height = layers[0].rows();
+
+    // channels must be listed, and stored, in alphabetical order
+    struct Channel {
+	std::string name;
+	size_t layer;
+	size_t component;
+    };
+    std::vector<Channel> channels;
+    bool long_names = false;
+    for (size_t layer = 0; layer < layers.size(); layer++) {
+	static const char* suffixes[3] = {".R", ".G", ".B"};
+	for (size_t component = 0; component < 3; component++) {
+	    std::string name = layer_names[layer] + suffixes[component];
+	    channels.push_back({name, layer, component});
+	    long_names = long_names || name.size() > 31;
+	}
+    }
+    std::sort(channels.begin(), channels.end(),
+	      [](const Channel& a, const Channel& b) { return a.name < b.name; });
+
+    std::stringstream header;
+    static const char exr_magic[4] = {0x76, 0x2f, 0x31, 0x01};
+    header.write(exr_magic, sizeof(exr_magic));
+    // single-part scanline file, of version 2
+    write_raw<int32_t>(header, long_names ? 0x402 : 0x2);
+
+    std::stringstream channel_list;
+    for (const Channel& channel : channels) {
+	channel_list << channel.name << '\0';
+	// half pixels, perceptually linear, 3 reserved bytes, x and y sampling
+	write_raw<int32_t>(channel_list, 1);
+	write_raw<int32_t>(channel_list, 0);
+	write_raw<int32_t>(channel_list, 1);
+	write_raw<int32_t>(channel_list, 1);
+    }
+    channel_list << '\0';
+
+    std::vector<int32_t> window = {0, 0, static_cast<int32_t>(width) - 1, static_cast<int32_t>(height) - 1};
+    write_exr_attribute(header, "channels", "chlist", channel_list.str());
+    write_exr_attribute(header, "compression", "compression", std::string(1, '\0'));
+    write_exr_attribute(header, "dataWindow", "box2i", exr_value(window));
+    write_exr_attribute(header, "displayWindow", "box2i", exr_value(window));
+    write_exr_attribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));
+    write_exr_attribute(header, "pixelAspectRatio", "float", exr_value(std::vector<float>{1.0f}));
+    write_exr_attribute(header, "screenWindowCenter", "v2f", exr_value(std::vector<float>{0.0f, 0.0f}));
+    write_exr_attribute(header, "screenWindowWidth", "float", exr_value(std::vector<float>{1.0f}));
+    header << '\0';
+
+    // uncompressed files hold a chunk per scanline : its y, its size, then
+    // the halves of each channel
+    size_t line_size = channels.size() * width * sizeof(uint16_t);
+    size_t chunk_size = 2 * sizeof(int32_t) + line_size;
+    std::string header_bytes = header.str();
+
+    std::vector<uint64_t> offsets(height);
+    for (size_t row = 0; row < height; row++) {
+	offsets[row] = header_bytes.size() + height * sizeof(uint64_t) + row * chunk_size;
+    }
+
+    static const size_t block_rows = 16;
+    std::vector<char> chunks(height * chunk_size);
+    pool.parallel_for(0, (height + block_rows - 1) / block_rows, [&](size_t block) {
+	    std::vector<RGBHalf> halves(width);
+	    for (size_t row = block * block_rows; row < std::min((block + 1) * block_rows, height); row++) {
+		char* chunk = &chunks[row * chunk_size];
+		int32_t header_fields[2] = {static_cast<int32_t>(row), static_cast<int32_t>(line_size)};
+		std::memcpy(chunk, header_fields, sizeof(header_fields));
+		uint16_t* data = reinterpret_cast<uint16_t*>(chunk + sizeof(header_fields));
+
+		size_t converted_layer = layers.size();
+		for (const Channel& channel : channels) {
+		    if (channel.layer != converted_layer) {
+			for (size_t col = 0; col < width; col++) {
+			    halves[col] = RGBHalf(layers[channel.layer](row, col));
+			}
+			converted_layer = channel.layer;
+		    }
+
+		    for (size_t col = 0; col < width; col++) {
+			const RGBHalf& h = halves[col];
+			*data++ = channel.component == 0 ? h.r : channel.component == 1 ? h.g : h.b;
+		    }
+		}
+	    }
+	});
+
+    out << header_bytes;
+    write_raw(out, offsets.data(), offsets.size());
+    write_raw(out, chunks.data(), chunks.size());
+}
+
+#ifdef WITH_ZLIB
+static uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+	return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Filters a row of RGB bytes with the PNG filter leaving the smallest bytes,
+// as stb_image_write does, and writes the filter type then the filtered bytes.
+// The previous row is null for the first one.
+static void filter_png_row(const uint8_t* row, const uint8_t* previous, size_t size, uint8_t* filtered) {
+    static const size_t bpp = 3;
+    std::vector<uint8_t> line(size);
+    long best_estimate = std::numeric_limits<long>::max();
+
+    for (uint8_t type = 0; type < 5; type++) {
+	long estimate = 0;
+	for (size_t i = 0; i < size; i++) {
+	    int a = i >= bpp ? row[i - bpp] : 0;
+	    int b = previous ? previous[i] : 0;
+	    int c = previous && i >= bpp ? previous[i - bpp] : 0;
+	    int predicted = type == 0 ? 0 : type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : paeth(a, b, c);
+	    line[i] = static_cast<uint8_t>(row[i] - predicted);
+	    estimate += std::abs(static_cast<int8_t>(line[i]));
+	}
+
+	if (estimate < best_estimate) {
+	    best_estimate = estimate;
+	    filtered[0] = type;
+	    std::copy(line.begin(), line.end(), filtered + 1);
+	}
+    }
+}
+
+static void write_be32(std::ostream& out, uint32_t value) {
+    uint8_t bytes[4] = {static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+			static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)};
+    write_raw(out, bytes, sizeof(bytes));
+}
+
+static void write_png_chunk(std::ostream& out, const char* type, const uint8_t* data, size_t size) {
+    write_be32(out, size);
+    out.write(type, 4);
+    write_raw(out, data, size);
+
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0) {
+	crc = crc32(crc, data, size);
+    }
+    write_be32(out, crc);
+}
+#endif
+
+void write_png(const Buffer2D<RGB8>& colors, ThreadPool& pool, std::ostream& out) {
+#ifndef WITH_ZLIB
+    (void) pool;
+    write_png(colors, out);
+#else
+    size_t width = colors.columns();
+    size_t height = colors.rows();
+    size_t row_size = width * sizeof(RGB8);
+    size_t line_size = row_size + 1;
+
+    // blocks of rows are deflated independently, each primed with the end of
+    // the previous one, and ended on a byte boundary to be concatenated
+    size_t block_rows = std::max<size_t>(1, (1 << 18) / line_size);
+    size_t block_count = std::max<size_t>(1, (height + block_rows - 1) / block_rows);
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(colors.data());
+
+    std::vector<uint8_t> filtered(height * line_size);
+    pool.parallel_for(0, height, [&](size_t row) {
+	    filter_png_row(pixels + row * row_size, row > 0 ? pixels + (row - 1) * row_size : nullptr,
+			   row_size, &filtered[row * line_size]);
+	}, block_rows);
+
+    std::vector<std::vector<uint8_t>> blocks(block_count);
+    std::vector<uLong> adlers(block_count);
+    pool.parallel_for(0, block_count, [&](size_t block) {
+	    size_t begin = std::min(block * block_rows, height) * line_size;
+	    size_t end = std::min((block + 1) * block_rows, height) * line_size;
+	    bool last = block + 1 == block_count;
+
+	    z_stream stream;
+	    std::memset(&stream, 0, sizeof(stream));
+	    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("Could not initialize deflate");
+	    }
+	    size_t dictionary_size = std::min<size_t>(begin, 1 << 15);
+	    if (dictionary_size > 0) {
+		deflateSetDictionary(&stream, &filtered[begin - dictionary_size], dictionary_size);
+	    }
+
+	    // with room for the empty block ending a sync flush
+	    std::vector<uint8_t>& output = blocks[block];
+	    output.resize(deflateBound(&stream, end - begin) + 16);
+	    stream.next_in = filtered.data() + begin;
+	    stream.avail_in = end - begin;
+	    stream.next_out = output.data();
+	    stream.avail_out = output.size();
+
+	    int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+	    output.resize(output.size() - stream.avail_out);
+	    deflateEnd(&stream);
+	    if (result != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) {
+		throw std::runtime_error("Could not deflate the image");
+	    }
+
+	    adlers[block] = adler32(adler32(0, nullptr, 0), filtered.data() + begin, end - begin);
+	});
+
+    uLong adler = adlers[0];
+    for (size_t block = 1; block < block_count; block++) {
+	size_t size = (std::min((block + 1) * block_rows, height) - block * block_rows) * line_size;
+	adler = adler32_combine(adler, adlers[block], size);
+    }
+
+    // zlib header, and checksum after the last block
+    static const uint8_t zlib_header[2] = {0x78, 0x9c};
+    blocks.front().insert(blocks.front().begin(), zlib_header, zlib_header + sizeof(zlib_header));
+    for (int shift = 24; shift >= 0; shift -= 8) {
+	blocks.back().push_back(static_cast<uint8_t>(adler >> shift));
+    }
+
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    write_raw(out, signature, sizeof(signature));
+
+    // 8-bit RGB, deflated, adaptive filtering, not interlaced
+    uint8_t header[13] = {0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0};
+    for (size_t i = 0; i < 4; i++) {
+	header[i] = static_cast<uint8_t>(width >> (24 - 8 * i));
+	header[4 + i] = static_cast<uint8_t>(height >> (24 - 8 * i));
+    }
+    write_png_chunk(out, "IHDR", header, sizeof(header));
+
+    for (const std::vector<uint8_t>& block : blocks) {
+	write_png_chunk(out, "IDAT", block.data(), block.size());
+    }
+    write_png_chunk(out, "IEND", nullptr, 0);
+#endif
+}
+
 Buffer2D<RGB8> read_png(const std::string& filepath) {
     int x, y;
     unsigned char* data = stbi_load(filepath.c_str(), &x, &y, nullptr, 3);
@@ -183,7 +792,7 @@ Buffer2D<RGB8> read_png(const std::string& filepath) {
 	throw std::runtime_error("Could not open " + filepath);
     }
 
-    Buffer2D<RGB8> result(x, y);
+    Buffer2D<RGB8> result(y, x);
 
     memcpy(&result(0, 0), data, x * y * sizeof(RGB8));
 
@@ -194,9 +803,25 @@ Buffer2D<RGB8> read_png(const std::string& filepath) {
 
 
 size_t RGBFilm::width() const {
-    return colors_.columns();
+    return weights_.columns();
 }
 
 size_t RGBFilm::height() const {
-    return colors_.rows();
+    return image_height_;
+}
+
+size_t RGBFilm::first_row() const {
+    return first_row_;
+}
+
+size_t RGBFilm::row_count() const {
+    return weights_.rows();
+}
+
+size_t RGBFilm::layer_count() const {
+    return layer_count_;
+}
+
+bool RGBFilm::compact() const {
+    return compact_;
 }
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <iostream>
 #include <vector>
 #include "Color.hpp"
+#include "Filter.hpp"
+
+class ThreadPool;
 
 enum ResizeFilter { NEAREST_NEIGHBOUR, BILINEAR };
 
@@ -55,32 +60,162 @@ Buffer2D<T> resized(const Buffer2D<T>& buffer, size_t new_rows, size_t new_colum
     return new_buffer;
 }
 
-Buffer2D<RGB8> to_rgb8(const Buffer2D<RGBColor>& color);
+Buffer2D<RGB8> to_rgb8(const Buffer2D<RGBColor>& color, const ToneMapper& tone = ToneMapper());
 Buffer2D<RGBColor> to_rgbcolor(const Buffer2D<RGB8>& color);
 
 Buffer2D<RGB8> read_png(const std::string& filepath);
+// Linear colors of a portable float map, color or grayscale ; throws
+// std::runtime_error for invalid files
+Buffer2D<RGBColor> read_pfm(const std::string& filepath);
+
+// Running statistics of the luminance of the samples taken inside a pixel,
+// used to estimate how converged it is
+struct PixelStats {
+    float count;
+    float mean;
+    // sum of the squared differences to the mean
+    float m2;
+
+    PixelStats();
+
+    void add(float x);
+    void merge(const PixelStats& other);
+
+    // Standard error of the mean, relative to the mean ; dark pixels are
+    // compared to a minimum luminance instead
+    float relative_error() const;
+};
 
-class RGBFilm {
+// Rectangle of an RGBFilm, extended by an apron wide enough to hold the filter
+// footprint of any sample taken inside the rectangle.
+// A tile is private to the thread splatting samples to it, and is merged back
+// into the film afterwards.
+class RGBFilmTile {
 private:
+    size_t row0_;
+    size_t col0_;
+    size_t film_width_;
+    size_t film_height_;
+    size_t layer_count_;
     Buffer2D<RGBColor> colors_;
     Buffer2D<float> weights_;
-    float filter_radius_;
+    Buffer2D<PixelStats> stats_;
+    // filter of the film the tile belongs to
+    const Filter* filter_;
+
+    // without statistics, the tile keeps no PixelStats
+    RGBFilmTile(size_t row0, size_t col0, size_t rows, size_t columns,
+		size_t film_width, size_t film_height, size_t layer_count, const Filter* filter,
+		bool statistics);
 
-    void add_sample(size_t row, size_t col, const RGBColor& color, float weight);
-    RGBColor get_color(size_t row, size_t col) const;
+    friend class RGBFilm;
     
 public:
-    RGBFilm(size_t width, size_t height, float filter_radius=1.0f);
-
-    void add_sample(const Vec2& pos, RGBColor color);
+    // colors holds the sample color of each layer
+    void add_sample(const Vec2& pos, const std::vector<RGBColor>& colors);
+};
 
-    Buffer2D<RGBColor> get_colors() const;
-    Buffer2D<RGB8> get_image() const;
+// Film with several layers of color, filtered from the same image samples.
+// The layers of a pixel are stored next to each other and share the filter
+// weights, so a sample costs a single footprint traversal for all layers.
+// A film may hold only a band of rows of the image, which can be moved down it.
+// A pixel costs 12 bytes per layer and 4 for the weight, plus 12 for its
+// statistics.
+// A compact film holds the weighted mean of each layer in half floats instead,
+// and no statistics, so it can't drive adaptive sampling or noise targets :
+// a pixel costs 6 bytes per layer and 4 for the weight. Merged tiles update the
+// means with stochastic rounding, which is unbiased and doesn't stall however
+// many tiles are merged, but adds noise of about sqrt(merges / 3) half ulps
+// (2^-11 of the mean) : merging fewer tiles of more samples keeps it low.
+// The means are resolved colors, read without dividing by the weight.
+class RGBFilm {
+private:
+    size_t layer_count_;
+    bool compact_;
+    // image rows held in the buffers, from first_row_
+    size_t first_row_;
+    size_t image_height_;
+    // rows held, of width * layer_count weighted sums, empty for compact films
+    Buffer2D<RGBColor> colors_;
+    // the same for compact films, of weighted means
+    Buffer2D<RGBHalf> means_;
+    Buffer2D<float> weights_;
+    // statistics of the samples taken in each pixel, over all layers, empty
+    // for compact films
+    Buffer2D<PixelStats> stats_;
+    Filter filter_;
+
+    // rows are relative to the first row held
+    RGBColor get_color(size_t row, size_t col, size_t layer) const;
+    // Adds the weighted sums of the layers of a pixel of a compact film
+    void accumulate(size_t row, size_t col, const RGBColor* sums, float weight);
+    
+public:
+    RGBFilm(size_t width, size_t height, size_t layer_count=1, const Filter& filter=Filter(),
+	    bool compact=false);
+    // Film of the rows [first_row, first_row + rows) of an image of the given size
+    RGBFilm(size_t width, size_t height, size_t first_row, size_t rows,
+	    size_t layer_count, const Filter& filter, bool compact=false);
+    // Reads the accumulators written by write()
+    RGBFilm(std::istream& in);
+
+    // Number of pixels a tile extends past its rectangle on each side
+    size_t apron() const;
+    
+    // Empty tile for samples taken in rows [rowmin, rowmax) and columns [colmin, colmax)
+    // it must not outlive the film
+    RGBFilmTile make_tile(size_t rowmin, size_t rowmax, size_t colmin, size_t colmax) const;
+
+    // Tiles must not be merged concurrently if their aprons overlap, and must
+    // lie in the rows held
+    void merge_tile(const RGBFilmTile& tile);
+    // Adds the samples of a film of the same size, layers and filter, compact
+    // or not ; throws std::invalid_argument otherwise. The film becomes
+    // compact if the other one is.
+    void merge(const RGBFilm& other);
+
+    // Removes every sample
+    void clear();
+    // Moves the band of rows held down the image to start at first_row : the
+    // rows held already are kept, the others are empty
+    void advance(size_t first_row);
+
+    // Writes the raw accumulators of the film, to resume from
+    void write(std::ostream& out) const;
+
+    // Images of the rows held
+    Buffer2D<RGBColor> get_colors(size_t layer) const;
+    Buffer2D<RGB8> get_image(size_t layer, const ToneMapper& tone = ToneMapper()) const;
+    // Writes the pixels of a rectangle of a layer to the same pixels of
+    // image, packed as 0x00RRGGBB
+    void get_packed_pixels(size_t layer, size_t rowmin, size_t rowmax, size_t colmin, size_t colmax,
+			   Buffer2D<uint32_t>& image, const ToneMapper& tone = ToneMapper()) const;
+
+    // Not for compact films
+    const PixelStats& get_stats(size_t row, size_t col) const;
+    // Number of samples taken in each pixel, as shades of gray up to the
+    // maximum ; not for compact films
+    Buffer2D<RGB8> get_sample_count_image() const;
     
     size_t width() const;
+    // of the image, not of the rows held
     size_t height() const;
+    size_t first_row() const;
+    size_t row_count() const;
+    size_t layer_count() const;
+    bool compact() const;
 };
 
 void write_png(const Buffer2D<RGB8>& colors, std::ostream& out);
+// Filters and deflates blocks of rows in parallel on the pool, if built with
+// zlib, and writes them with a few large writes
+void write_png(const Buffer2D<RGB8>& colors, ThreadPool& pool, std::ostream& out);
 void write_ppm(const Buffer2D<RGB8>& colors, std::ostream& out);
+// Linear colors, as a little-endian portable float map
+void write_pfm(const Buffer2D<RGBColor>& colors, std::ostream& out);
+// Linear colors of images of the same size, as the layers of an uncompressed
+// OpenEXR file with half-float channels named <layer name>.R, .G and .B.
+// Blocks of scanlines are encoded in parallel by the pool.
+void write_exr(const std::vector<std::string>& layer_names, const std::vector<Buffer2D<RGBColor>>& layers,
+	       ThreadPool& pool, std::ostream& out);
 
@@ -7,12 +7,21 @@
 class Shape;
 class Material;
 
+// Closest hit of a ray. Traversal only records which primitive of which
+// shape is hit, and where on it : the distance is the tmax of the ray. The
+// shading attributes are then computed once, by Shape::hit_attributes.
 struct Intersect {
     Vec3 point;
     Vec3 wo;
     
     const Shape* shape;
     const Material* material;
+
+    // index of the triangle hit in a mesh, and barycentric coordinates of
+    // the hit on it, along its second and third vertices
+    size_t primitive;
+    float u;
+    float v;
     
     Vec3 normal;
     Vec3 local_x;
@@ -21,7 +30,10 @@ struct Intersect {
 
     Intersect()
         : shape(nullptr),
-          material(nullptr) {
+          material(nullptr),
+          primitive(0),
+          u(0.0f),
+          v(0.0f) {
     }
 
     void setup_local_basis() {
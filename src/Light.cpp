@@ -45,6 +45,7 @@ LightSample AreaLight::sample(const Vec3& point) const {
             1.0f
         );
     }
+    shape_->hit_attributes(itx_ray, itx);
 
     on_light = itx_ray.target();
 
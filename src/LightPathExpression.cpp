@@ -1,4 +1,9 @@
 #include "LightPathExpression.hpp"
+#include "PathSignature.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <map>
 
 SurfaceType surface_type_from_char(char c) {
     switch(c) {
@@ -106,3 +111,139 @@ static bool match(const LightPathExpression& pattern, const LightPathExpression&
 bool match(const LightPathExpression& pattern, const LightPathExpression& expr) {
     return match(pattern, expr, 0, 0);
 }
+
+// A state of the non-deterministic automaton : a pattern index, and a
+// position in that pattern (read from the end)
+typedef std::pair<size_t, size_t> PatternPosition;
+typedef std::vector<PatternPosition> PatternPositionSet;
+
+static void add_position(const std::vector<LightPathExpression>& patterns,
+			 PatternPositionSet& set,
+			 size_t pattern, size_t position) {
+    PatternPosition p(pattern, position);
+    if (std::find(set.begin(), set.end(), p) != set.end()) {
+	return;
+    }
+    set.push_back(p);
+
+    // '*' can match an empty sequence
+    const LightPathExpression& pat = patterns[pattern];
+    if (position < pat.length()
+	&& pat[pat.length() - 1 - position] == SurfaceType::REPEAT) {
+	add_position(patterns, set, pattern, position + 1);
+    }
+}
+
+static PatternPositionSet step_positions(const std::vector<LightPathExpression>& patterns,
+					 const PatternPositionSet& set,
+					 SurfaceType surface_type) {
+    PatternPositionSet result;
+    for (const PatternPosition& p : set) {
+	const LightPathExpression& pat = patterns[p.first];
+	if (p.second == pat.length()) {
+	    continue;
+	}
+	
+	switch (pat[pat.length() - 1 - p.second]) {
+	case SurfaceType::REPEAT:
+	    add_position(patterns, result, p.first, p.second);
+	    break;
+	case SurfaceType::ANY:
+	    add_position(patterns, result, p.first, p.second + 1);
+	    break;
+	default:
+	    if (pat[pat.length() - 1 - p.second] == surface_type) {
+		add_position(patterns, result, p.first, p.second + 1);
+	    }
+	}
+    }
+    std::sort(result.begin(), result.end());
+    
+    return result;
+}
+
+const LightPathAutomaton::State LightPathAutomaton::DEAD;
+
+LightPathAutomaton::LightPathAutomaton(const std::vector<LightPathExpression>& patterns)
+    : max_path_length_(0) {
+    static const size_t symbol_count = SurfaceType::ANY;
+
+    PatternPositionSet start;
+    for (size_t i = 0; i < patterns.size(); i++) {
+	add_position(patterns, start, i, 0);
+
+	bool repeats = false;
+	for (size_t j = 0; j < patterns[i].length(); j++) {
+	    repeats = repeats || patterns[i][j] == SurfaceType::REPEAT;
+	}
+	if (repeats) {
+	    max_path_length_ = std::numeric_limits<size_t>::max();
+	} else {
+	    max_path_length_ = std::max(max_path_length_, patterns[i].length());
+	}
+    }
+    std::sort(start.begin(), start.end());
+
+    // subset construction, state 0 being the empty (dead) set
+    std::vector<PatternPositionSet> sets;
+    std::map<PatternPositionSet, State> ids;
+    sets.push_back(PatternPositionSet());
+    ids[sets.back()] = DEAD;
+    sets.push_back(start);
+    ids[start] = 1;
+
+    for (State s = 0; s < sets.size(); s++) {
+	std::vector<size_t> matched;
+	for (const PatternPosition& p : sets[s]) {
+	    if (p.second == patterns[p.first].length()) {
+		matched.push_back(p.first);
+	    }
+	}
+	std::sort(matched.begin(), matched.end());
+	matches_.push_back(matched);
+
+	for (size_t t = 0; t < symbol_count; t++) {
+	    PatternPositionSet next = step_positions(patterns, sets[s], static_cast<SurfaceType>(t));
+
+	    auto it = ids.find(next);
+	    if (it == ids.end()) {
+		it = ids.insert(std::make_pair(next, sets.size())).first;
+		sets.push_back(next);
+	    }
+	    transitions_.push_back(it->second);
+	}
+    }
+}
+
+LightPathAutomaton::State LightPathAutomaton::start() const {
+    return 1;
+}
+
+LightPathAutomaton::State LightPathAutomaton::step(State state, SurfaceType surface_type) const {
+    assert(surface_type < SurfaceType::ANY);
+    return transitions_[state * SurfaceType::ANY + surface_type];
+}
+
+LightPathAutomaton::State LightPathAutomaton::run(const PathSignature& path) const {
+    State state = start();
+    for (size_t i = 0; i < path.length() && !is_dead(state); i++) {
+	state = step(state, path[i]);
+    }
+    return state;
+}
+
+bool LightPathAutomaton::is_dead(State state) const {
+    return state == DEAD;
+}
+
+bool LightPathAutomaton::accepts(State state) const {
+    return !matches_[state].empty();
+}
+
+const std::vector<size_t>& LightPathAutomaton::matches(State state) const {
+    return matches_[state];
+}
+
+size_t LightPathAutomaton::max_path_length() const {
+    return max_path_length_;
+}
@@ -2,6 +2,7 @@
 
 #include "Material.hpp"
 #include <vector>
+#include <string>
 
 SurfaceType surface_type_from_char(char c);
 char surface_type_to_char(SurfaceType t);
@@ -26,3 +27,40 @@ public:
 std::ostream& operator<<(std::ostream& out, const LightPathExpression& expr);
 
 bool match(const LightPathExpression& pattern, const LightPathExpression& expr);
+
+class PathSignature;
+
+// Deterministic automaton matching a set of light path expressions at once.
+// Paths are read in tracing order, from the eye towards the light, so that
+// the integrator can stop extending a path as soon as no expression can
+// match it anymore.
+class LightPathAutomaton {
+public:
+    typedef size_t State;
+
+private:
+    // transitions_[state * ANY + surface_type], for the surface types that
+    // can appear in a path (EYE, DIFFUSE, SPECULAR and LIGHT)
+    std::vector<State> transitions_;
+    std::vector<std::vector<size_t>> matches_;
+    size_t max_path_length_;
+
+public:
+    static const State DEAD = 0;
+    
+    LightPathAutomaton(const std::vector<LightPathExpression>& patterns);
+
+    State start() const;
+    State step(State state, SurfaceType surface_type) const;
+    State run(const PathSignature& path) const;
+
+    bool is_dead(State state) const;
+    bool accepts(State state) const;
+
+    // indices of the expressions matching the paths ending in this state
+    const std::vector<size_t>& matches(State state) const;
+
+    // length of the longest path that can be matched,
+    // or SIZE_MAX if an expression contains '*'
+    size_t max_path_length() const;
+};
@@ -1,7 +1,11 @@
 #include "LightTree.hpp"
 
 LightTree::LightTree(SurfaceType type, const RGBColor& emitted)
-    : type_(type), emitted_(emitted) {
+    : pruned_upstream_count_(0), type_(type), emitted_(emitted) {
+}
+
+size_t LightTree::upstream_count() const {
+    return upstream_.size() + pruned_upstream_count_;
 }
 
 RGBColor LightTree::radiance() const {
@@ -9,8 +13,8 @@ RGBColor LightTree::radiance() const {
     for (size_t i = 0; i < upstream_.size(); i++) {
 	out += attenuations_[i] * upstream_[i]->radiance();
     }
-    if (upstream_.size() > 0) {
-	out /= upstream_.size();
+    if (upstream_count() > 0) {
+	out /= upstream_count();
     }
 
     out += emitted_;
@@ -27,6 +31,14 @@ void LightTree::add_upstream(const LightTree* tree) {
     add_upstream(tree, RGBColor::gray(1.0f));
 }
 
+void LightTree::add_pruned_upstream() {
+    pruned_upstream_count_++;
+}
+
+bool LightTree::has_traced_upstream() const {
+    return !upstream_.empty();
+}
+
 LightTree::~LightTree() {
     for (const LightTree* tree : upstream_) {
         delete tree;
@@ -62,15 +74,15 @@ void LightTree::print() const {
 
 
 void LightTree::get_all_radiances(
-    LightPathExpression& base,
-    std::vector<std::pair<LightPathExpression, RGBColor>>& radiances,
+    PathSignature& base,
+    std::vector<std::pair<PathSignature, RGBColor>>& radiances,
     RGBColor attenuation
     ) const {
     base.push_back(type_);
     radiances.push_back(std::make_pair(base, emitted_ * attenuation));
 
     for (size_t i = 0; i < upstream_.size(); i++) {
-	RGBColor att = attenuation * attenuations_[i] / static_cast<float>(upstream_.size());
+	RGBColor att = attenuation * attenuations_[i] / static_cast<float>(upstream_count());
 	upstream_[i]->get_all_radiances(base, radiances, att);
     }
     
@@ -78,15 +90,11 @@ void LightTree::get_all_radiances(
 }
 
 
-std::vector<std::pair<LightPathExpression, RGBColor>>
+std::vector<std::pair<PathSignature, RGBColor>>
 LightTree::get_all_radiances() const {
-    LightPathExpression base;
-    std::vector<std::pair<LightPathExpression, RGBColor>> radiances;
+    PathSignature base;
+    std::vector<std::pair<PathSignature, RGBColor>> radiances;
     get_all_radiances(base, radiances, RGBColor::gray(1.0f));
 
-    for (auto& p : radiances) {
-	p.first.reverse();
-    }
-
     return radiances;
 }
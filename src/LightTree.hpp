@@ -7,12 +7,13 @@
 #include "Color.hpp"
 #include "Intersect.hpp"
 #include "Material.hpp"
-#include "LightPathExpression.hpp"
+#include "PathSignature.hpp"
 
 class LightTree {
 private:
     std::vector<const LightTree*> upstream_;
     std::vector<RGBColor> attenuations_;
+    size_t pruned_upstream_count_;
 
     SurfaceType type_;
     RGBColor emitted_;
@@ -23,9 +24,11 @@ private:
     
     void print(std::vector<bool>& last_child) const;
 
+    size_t upstream_count() const;
+
     void get_all_radiances(
-	LightPathExpression& base,
-	std::vector<std::pair<LightPathExpression, RGBColor>>& radiances,
+	PathSignature& base,
+	std::vector<std::pair<PathSignature, RGBColor>>& radiances,
 	RGBColor attenuation
 	) const;
     
@@ -37,9 +40,18 @@ public:
     void add_upstream(const LightTree* tree, RGBColor color);
     void add_upstream(const LightTree* tree);
 
+    // account for an upstream branch that was not traced because no light
+    // path expression could match it
+    void add_pruned_upstream();
+
+    // whether some upstream branch was traced, and its share of the radiance
+    // depends on the number of upstream branches
+    bool has_traced_upstream() const;
+
     void print() const;
 
-    std::vector<std::pair<LightPathExpression, RGBColor>>
+    // radiance carried by every path of the tree, with paths in tracing order
+    std::vector<std::pair<PathSignature, RGBColor>>
     get_all_radiances() const;
 
     ~LightTree();
@@ -227,3 +227,61 @@ template<typename T, size_t N>
 Matrix<T, N, 1> column_matrix(const Vec<T, N>& v) {
     return Matrix<T, N, 1>(v.co_);
 }
+
+#ifdef __SSE__
+// 4x4 float matrices are held as 4 rows of an SSE register each. The products
+// accumulate in the order of the generic loops, and give the same results.
+#include <xmmintrin.h>
+
+template<>
+inline Matrix<float, 4, 4> operator*(const Matrix<float, 4, 4>& lhs, const Matrix<float, 4, 4>& rhs) {
+    __m128 rhs_rows[4];
+    for (size_t k = 0; k < 4; k++) {
+	rhs_rows[k] = _mm_loadu_ps(&rhs(k, 0));
+    }
+
+    Matrix<float, 4, 4> result;
+    for (size_t i = 0; i < 4; i++) {
+	__m128 row = _mm_setzero_ps();
+	for (size_t k = 0; k < 4; k++) {
+	    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(lhs(i, k)), rhs_rows[k]));
+	}
+	_mm_storeu_ps(&result(i, 0), row);
+    }
+
+    return result;
+}
+
+template<>
+inline Vec<float, 4> operator*(const Matrix<float, 4, 4>& lhs, const Vec<float, 4>& rhs) {
+    __m128 columns[4];
+    for (size_t i = 0; i < 4; i++) {
+	columns[i] = _mm_loadu_ps(&lhs(i, 0));
+    }
+    _MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+
+    __m128 sum = _mm_setzero_ps();
+    for (size_t k = 0; k < 4; k++) {
+	sum = _mm_add_ps(sum, _mm_mul_ps(columns[k], _mm_set1_ps(rhs[k])));
+    }
+
+    float result[4];
+    _mm_storeu_ps(result, sum);
+    return Vec<float, 4>(result);
+}
+
+template<>
+inline SquareMatrix<float, 4> SquareMatrix<float, 4>::transpose() const {
+    __m128 rows[4];
+    for (size_t i = 0; i < 4; i++) {
+	rows[i] = _mm_loadu_ps(&(*this)(i, 0));
+    }
+    _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+
+    SquareMatrix<float, 4> result;
+    for (size_t i = 0; i < 4; i++) {
+	_mm_storeu_ps(&result(i, 0), rows[i]);
+    }
+    return result;
+}
+#endif
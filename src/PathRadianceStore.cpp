@@ -0,0 +1,187 @@
+#include "PathRadianceStore.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+
+#include "util.hpp"
+
+static const char store_magic[8] = {'L', 'P', 'S', 'T', 'O', 'R', 'E', '2'};
+
+PathRadianceStore::PathRadianceStore(size_t width, size_t height, size_t max_length, const Filter& filter)
+    : width_(width), height_(height), max_length_(max_length), filter_(filter),
+      entries_(width * height), weights_(width * height), row_locks_(height) {
+    if (max_length >= PathSignature::max_length) {
+	throw std::invalid_argument("Path store length is too large");
+    }
+}
+
+void PathRadianceStore::clear() {
+    for (std::vector<Entry>& entries : entries_) {
+	entries.clear();
+    }
+    std::fill(weights_.begin(), weights_.end(), 0.0f);
+}
+
+PathRadianceStore::PathRadianceStore(std::istream& in) {
+    char magic[sizeof(store_magic)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, store_magic, sizeof(magic)) != 0) {
+	throw std::runtime_error("Not a path store file");
+    }
+    
+    width_ = read_raw<uint64_t>(in);
+    height_ = read_raw<uint64_t>(in);
+    max_length_ = read_raw<uint64_t>(in);
+    FilterType filter_type = static_cast<FilterType>(read_raw<uint32_t>(in));
+    float filter_radius = read_raw<float>(in);
+    filter_ = Filter(filter_type, filter_radius);
+
+    weights_.resize(width_ * height_);
+    entries_.resize(width_ * height_);
+    
+    for (size_t i = 0; i < weights_.size(); i++) {
+	weights_[i] = read_raw<float>(in);
+	
+	entries_[i].resize(read_raw<uint32_t>(in));
+	for (Entry& e : entries_[i]) {
+	    e.key = read_raw<uint64_t>(in);
+	    for (size_t c = 0; c < 3; c++) {
+		e.radiance[c] = read_raw<float>(in);
+	    }
+	}
+    }
+    std::vector<std::mutex>(height_).swap(row_locks_);
+}
+
+void PathRadianceStore::add_radiance(size_t row, size_t col, uint64_t key, const RGBColor& radiance) {
+    std::vector<Entry>& pixel = entries_[row * width_ + col];
+
+    auto it = std::lower_bound(pixel.begin(), pixel.end(), key,
+			       [](const Entry& e, uint64_t k) { return e.key < k; });
+    if (it == pixel.end() || it->key != key) {
+	it = pixel.insert(it, Entry{key, RGBColor()});
+    }
+    it->radiance += radiance;
+}
+
+void PathRadianceStore::add_sample(const Vec2& pos, const std::vector<std::pair<PathSignature, RGBColor>>& radiances) {
+    // merge the contributions of identical paths first
+    std::vector<Entry> sample;
+    for (const auto& p : radiances) {
+	if (p.first.length() <= max_length_) {
+	    sample.push_back(Entry{p.first.key(), p.second});
+	}
+    }
+    std::sort(sample.begin(), sample.end(),
+	      [](const Entry& a, const Entry& b) { return a.key < b.key; });
+
+    size_t merged = 0;
+    for (size_t i = 0; i < sample.size(); i++) {
+	if (merged > 0 && sample[merged - 1].key == sample[i].key) {
+	    sample[merged - 1].radiance += sample[i].radiance;
+	} else {
+	    sample[merged++] = sample[i];
+	}
+    }
+    sample.resize(merged);
+    
+    FilterFootprint fp = filter_.footprint(pos, width_, height_);
+
+    float row_weights[Filter::max_footprint_width];
+    float col_weights[Filter::max_footprint_width];
+    filter_.weights(pos[1], fp.rowmin, fp.rowmax, row_weights);
+    filter_.weights(pos[0], fp.colmin, fp.colmax, col_weights);
+
+    for (size_t row = fp.rowmin; row <= fp.rowmax; row++) {
+	std::lock_guard<std::mutex> lock(row_locks_[row]);
+	for (size_t col = fp.colmin; col <= fp.colmax; col++) {
+	    float weight = row_weights[row - fp.rowmin] * col_weights[col - fp.colmin];
+
+	    weights_[row * width_ + col] += weight;
+	    for (const Entry& e : sample) {
+		add_radiance(row, col, e.key, e.radiance * weight);
+	    }
+	}
+    }
+}
+
+std::vector<Buffer2D<RGBColor>>
+PathRadianceStore::evaluate(const std::vector<LightPathExpression>& light_paths) const {
+    LightPathAutomaton automaton(light_paths);
+    if (automaton.max_path_length() > max_length_) {
+	std::cerr << "Warning : paths longer than " << max_length_
+		  << " vertices were not stored\n";
+    }
+
+    // distinct keys are few, only match each of them once
+    std::unordered_map<PathSignature, const std::vector<size_t>*> matches;
+    
+    std::vector<Buffer2D<RGBColor>> results(light_paths.size(), Buffer2D<RGBColor>(height_, width_));
+    
+    for (size_t row = 0; row < height_; row++) {
+	for (size_t col = 0; col < width_; col++) {
+	    float w = weights_[row * width_ + col];
+	    if (w == 0.0f) {
+		continue;
+	    }
+	    
+	    for (const Entry& e : entries_[row * width_ + col]) {
+		PathSignature path = PathSignature::from_key(e.key);
+		
+		auto it = matches.find(path);
+		if (it == matches.end()) {
+		    it = matches.insert(std::make_pair(path, &automaton.matches(automaton.run(path)))).first;
+		}
+
+		for (size_t i : *it->second) {
+		    results[i](row, col) += e.radiance / w;
+		}
+	    }
+	}
+    }
+
+    return results;
+}
+
+void PathRadianceStore::write(std::ostream& out) const {
+    out.write(store_magic, sizeof(store_magic));
+    write_raw<uint64_t>(out, width_);
+    write_raw<uint64_t>(out, height_);
+    write_raw<uint64_t>(out, max_length_);
+    write_raw<uint32_t>(out, filter_.type());
+    write_raw<float>(out, filter_.radius());
+    
+    for (size_t i = 0; i < weights_.size(); i++) {
+	write_raw<float>(out, weights_[i]);
+	
+	write_raw<uint32_t>(out, entries_[i].size());
+	for (const Entry& e : entries_[i]) {
+	    write_raw<uint64_t>(out, e.key);
+	    for (size_t c = 0; c < 3; c++) {
+		write_raw<float>(out, e.radiance[c]);
+	    }
+	}
+    }
+}
+
+size_t PathRadianceStore::width() const {
+    return width_;
+}
+
+size_t PathRadianceStore::height() const {
+    return height_;
+}
+
+size_t PathRadianceStore::max_length() const {
+    return max_length_;
+}
+
+size_t PathRadianceStore::entry_count() const {
+    size_t count = 0;
+    for (const auto& pixel : entries_) {
+	count += pixel.size();
+    }
+    return count;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <mutex>
+
+#include "Image.hpp"
+#include "PathSignature.hpp"
+
+// Radiance accumulated per pixel and per path signature, for every path up
+// to a given length. Any light path expression can then be evaluated after
+// rendering by summing the signatures it matches.
+// Unlike RGBFilm, samples carrying too much light are not clamped, since the
+// clamp would depend on the expression being evaluated.
+class PathRadianceStore {
+private:
+    struct Entry {
+	uint64_t key; // see PathSignature::key()
+	RGBColor radiance;
+    };
+    
+    size_t width_;
+    size_t height_;
+    size_t max_length_;
+    Filter filter_;
+
+    // entries of each pixel, sorted by key
+    std::vector<std::vector<Entry>> entries_;
+    std::vector<float> weights_;
+    std::vector<std::mutex> row_locks_;
+
+    PathRadianceStore& operator=(const PathRadianceStore& other);
+    PathRadianceStore(const PathRadianceStore& other);
+
+    void add_radiance(size_t row, size_t col, uint64_t key, const RGBColor& radiance);
+    
+public:
+    PathRadianceStore(size_t width, size_t height, size_t max_length, const Filter& filter);
+    PathRadianceStore(std::istream& in);
+
+    // radiances of the paths of a sample, in tracing order ;
+    // paths longer than max_length() are ignored
+    void add_sample(const Vec2& pos, const std::vector<std::pair<PathSignature, RGBColor>>& radiances);
+
+    std::vector<Buffer2D<RGBColor>> evaluate(const std::vector<LightPathExpression>& light_paths) const;
+
+    void write(std::ostream& out) const;
+
+    // Removes every sample
+    void clear();
+    
+    size_t width() const;
+    size_t height() const;
+    size_t max_length() const;
+    size_t entry_count() const;
+};
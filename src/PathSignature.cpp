@@ -0,0 +1,28 @@
+#include "PathSignature.hpp"
+
+const size_t PathSignature::max_length;
+
+PathSignature to_signature(const LightPathExpression& expr) {
+    PathSignature result;
+    for (size_t i = 0; i < expr.length(); i++) {
+	result.push_back(expr[i]);
+    }
+    result.reverse();
+    
+    return result;
+}
+
+LightPathExpression to_expression(const PathSignature& signature) {
+    PathSignature reversed = signature;
+    reversed.reverse();
+    
+    LightPathExpression result;
+    for (size_t i = 0; i < reversed.length(); i++) {
+	result.push_back(reversed[i]);
+    }
+    return result;
+}
+
+std::ostream& operator<<(std::ostream& out, const PathSignature& signature) {
+    return out << to_expression(signature);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "LightPathExpression.hpp"
+
+#include <cstdint>
+#include <cassert>
+#include <functional>
+
+// Compact representation of a traced path, for use in the render loop. Each
+// vertex is stored on 2 bits, the first vertex in the lowest bits. Vertices
+// are in tracing order, from the eye towards the light, whereas
+// LightPathExpression (used for parsing and display) goes the other way.
+class PathSignature {
+private:
+    uint64_t bits_;
+    uint8_t length_;
+
+    static const size_t bits_per_vertex = 2;
+    static const uint64_t vertex_mask = 3;
+
+public:
+    static const size_t max_length = 64 / bits_per_vertex;
+
+    PathSignature() : bits_(0), length_(0) {
+    }
+
+    PathSignature(uint64_t bits, size_t length) : bits_(bits), length_(length) {
+	assert(length <= max_length);
+    }
+
+    SurfaceType operator[](size_t idx) const {
+	assert(idx < length_);
+	return static_cast<SurfaceType>((bits_ >> (bits_per_vertex * idx)) & vertex_mask);
+    }
+    
+    size_t length() const { return length_; }
+    uint64_t bits() const { return bits_; }
+
+    void push_back(SurfaceType surface_type) {
+	assert(length_ < max_length);
+	assert(surface_type < SurfaceType::ANY);
+	bits_ |= static_cast<uint64_t>(surface_type) << (bits_per_vertex * length_);
+	length_++;
+    }
+
+    void pop_back() {
+	assert(length_ > 0);
+	length_--;
+	bits_ &= ~(vertex_mask << (bits_per_vertex * length_));
+    }
+
+    void reverse() {
+	if (length_ == 0) {
+	    return;
+	}
+	
+	// reverse the order of all 2-bit groups, then drop the unused ones
+	uint64_t x = bits_;
+	x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+	x = ((x >> 8) & 0x00FF00FF00FF00FFull) | ((x & 0x00FF00FF00FF00FFull) << 8);
+	x = ((x >> 16) & 0x0000FFFF0000FFFFull) | ((x & 0x0000FFFF0000FFFFull) << 16);
+	x = (x >> 32) | (x << 32);
+	
+	bits_ = x >> (64 - bits_per_vertex * length_);
+    }
+
+    // single word encoding of paths shorter than max_length, with a marker
+    // bit right above the last vertex
+    uint64_t key() const {
+	assert(length_ < max_length);
+	return bits_ | (static_cast<uint64_t>(1) << (bits_per_vertex * length_));
+    }
+
+    static PathSignature from_key(uint64_t key) {
+	size_t length = 0;
+	while (length + 1 < max_length && key >> (bits_per_vertex * (length + 1))) {
+	    length++;
+	}
+	uint64_t marker = static_cast<uint64_t>(1) << (bits_per_vertex * length);
+	return PathSignature(key ^ marker, length);
+    }
+
+    bool operator==(const PathSignature& other) const {
+	return bits_ == other.bits_ && length_ == other.length_;
+    }
+
+    bool operator!=(const PathSignature& other) const {
+	return !(*this == other);
+    }
+
+    bool operator<(const PathSignature& other) const {
+	return length_ < other.length_
+	    || (length_ == other.length_ && bits_ < other.bits_);
+    }
+};
+
+namespace std {
+    template<>
+    struct hash<PathSignature> {
+	size_t operator()(const PathSignature& s) const {
+	    return hash<uint64_t>()((s.bits() * 0x9E3779B97F4A7C15ull) ^ s.length());
+	}
+    };
+}
+
+// conversions between tracing order and light path expression order
+PathSignature to_signature(const LightPathExpression& expr);
+LightPathExpression to_expression(const PathSignature& signature);
+
+std::ostream& operator<<(std::ostream& out, const PathSignature& signature);
@@ -0,0 +1,114 @@
+#include "Preview.hpp"
+
+#include <cstring>
+
+Preview::Preview(size_t width, size_t height, size_t layer_count, double interval, const ToneMapper& tone)
+    : front_(0), frame_count_(0), tone_(tone), interval_(interval), last_publish_(0.0) {
+    for (Frame& frame : frames_) {
+	frame.layers.resize(layer_count, Buffer2D<uint32_t>(height, width));
+    }
+}
+
+void Preview::track_tiles(const std::vector<Tile>& tiles) {
+    tiles_ = tiles;
+
+    for (Frame& frame : frames_) {
+	frame.stale_tiles = std::vector<std::atomic<bool>>(tiles.size());
+	// the film is empty : the frames are kept until tiles are merged to
+	for (std::atomic<bool>& stale : frame.stale_tiles) {
+	    stale = false;
+	}
+    }
+}
+
+void Preview::invalidate(size_t tile) {
+    for (Frame& frame : frames_) {
+	frame.stale_tiles[tile] = true;
+    }
+}
+
+void Preview::refresh_and_swap(const RGBFilm& film, std::vector<std::mutex>& tile_locks, double time) {
+    Frame& back = frames_[1 - front_];
+
+    for (size_t i = 0; i < tiles_.size(); i++) {
+	// a tile merged to while it is refreshed stays stale
+	if (!back.stale_tiles[i].exchange(false)) {
+	    continue;
+	}
+
+	const Tile& tile = tiles_[i];
+	std::lock_guard<std::mutex> lock(tile_locks[i]);
+	for (size_t layer = 0; layer < back.layers.size(); layer++) {
+	    film.get_packed_pixels(layer, tile.rowmin, tile.rowmax, tile.colmin, tile.colmax, back.layers[layer],
+				   tone_);
+	}
+    }
+
+    swap();
+    last_publish_ = time;
+}
+
+void Preview::swap() {
+    std::lock_guard<std::mutex> lock(front_mtx_);
+    front_ = 1 - front_;
+    frame_count_++;
+}
+
+static void upsample(const std::vector<Buffer2D<RGBColor>>& layers, size_t scale, const ToneMapper& tone,
+		     std::vector<Buffer2D<uint32_t>>& frame) {
+    for (size_t layer = 0; layer < frame.size(); layer++) {
+	// the low resolution image is mapped once, then its pixels repeated
+	const Buffer2D<RGBColor>& colors = layers[layer];
+	Buffer2D<uint32_t> packed(colors.rows(), colors.columns());
+	tone.map_packed(colors.data(), colors.rows() * colors.columns(), packed.data());
+
+	Buffer2D<uint32_t>& image = frame[layer];
+	for (size_t row = 0; row < image.rows(); row++) {
+	    for (size_t col = 0; col < image.columns(); col++) {
+		image(row, col) = packed(row / scale, col / scale);
+	    }
+	}
+    }
+}
+
+void Preview::maybe_publish(const RGBFilm& film, std::vector<std::mutex>& tile_locks, double time) {
+    if (time - last_publish_ < interval_) {
+	return;
+    }
+
+    std::unique_lock<std::mutex> lock(publish_mtx_, std::try_to_lock);
+    // checked again, another thread may have just published
+    if (lock.owns_lock() && time - last_publish_ >= interval_) {
+	refresh_and_swap(film, tile_locks, time);
+    }
+}
+
+void Preview::publish(const RGBFilm& film, std::vector<std::mutex>& tile_locks, double time) {
+    std::lock_guard<std::mutex> lock(publish_mtx_);
+    refresh_and_swap(film, tile_locks, time);
+}
+
+void Preview::publish_upsampled(const std::vector<Buffer2D<RGBColor>>& layers, size_t scale) {
+    std::lock_guard<std::mutex> lock(publish_mtx_);
+
+    // the back frame is then only refreshed tile by tile, so both are drawn
+    upsample(layers, scale, tone_, frames_[1 - front_].layers);
+    swap();
+    upsample(layers, scale, tone_, frames_[1 - front_].layers);
+}
+
+bool Preview::copy_front(size_t layer, size_t& frame_number, uint32_t* pixels, size_t pitch) {
+    std::lock_guard<std::mutex> lock(front_mtx_);
+    if (frame_number == frame_count_) {
+	return false;
+    }
+
+    const Buffer2D<uint32_t>& image = frames_[front_].layers[layer];
+    for (size_t row = 0; row < image.rows(); row++) {
+	std::memcpy(reinterpret_cast<uint8_t*>(pixels) + row * pitch, &image(row, 0),
+		    image.columns() * sizeof(uint32_t));
+    }
+
+    frame_number = frame_count_;
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "Image.hpp"
+#include "TileScheduler.hpp"
+
+// Tone-mapped frames of a film, published by the renderer at a capped rate
+// for the preview window to show.
+// Frames are double-buffered : the renderer refreshes the back frame while the
+// window reads the front one, then swaps them. Only the tiles merged to since
+// a frame was last refreshed are tone-mapped again.
+class Preview {
+private:
+    struct Frame {
+	// one image per layer, of pixels packed as 0x00RRGGBB
+	std::vector<Buffer2D<uint32_t>> layers;
+	// tiles changed since the frame was last refreshed
+	std::vector<std::atomic<bool>> stale_tiles;
+    };
+
+    Frame frames_[2];
+    size_t front_;
+    // number of frames published so far
+    size_t frame_count_;
+
+    std::vector<Tile> tiles_;
+    ToneMapper tone_;
+    double interval_;
+    std::atomic<double> last_publish_;
+
+    // held by the thread refreshing the back frame
+    std::mutex publish_mtx_;
+    // held while the front frame is read, or swapped
+    std::mutex front_mtx_;
+
+    Preview& operator=(const Preview& other);
+    Preview(const Preview& other);
+
+    void refresh_and_swap(const RGBFilm& film, std::vector<std::mutex>& tile_locks, double time);
+    void swap();
+
+public:
+    // interval is the minimum time between frames, in seconds
+    Preview(size_t width, size_t height, size_t layer_count, double interval,
+	    const ToneMapper& tone = ToneMapper());
+
+    // Tiles the film is rendered in
+    void track_tiles(const std::vector<Tile>& tiles);
+    // To call once the pixels of a tile have changed
+    void invalidate(size_t tile);
+
+    // Publishes a frame if the last one is older than the interval, unless
+    // another thread is publishing already. The film is read under the lock
+    // of each tile.
+    void maybe_publish(const RGBFilm& film, std::vector<std::mutex>& tile_locks, double time);
+    // Publishes a frame right away
+    void publish(const RGBFilm& film, std::vector<std::mutex>& tile_locks, double time);
+    // Publishes a frame upsampled from images of each layer at 1/scale of the
+    // resolution, which the tiles of the film replace once they are merged to
+    void publish_upsampled(const std::vector<Buffer2D<RGBColor>>& layers, size_t scale);
+
+    // Copies the front frame of a layer to rows of pixels pitch bytes apart,
+    // if it isn't frame frame_number already, and updates frame_number
+    bool copy_front(size_t layer, size_t& frame_number, uint32_t* pixels, size_t pitch);
+};
@@ -1,23 +1,58 @@
 #include "Sampling.hpp"
 
-#include <random>
+#include <cmath>
 
-static std::uniform_real_distribution<float> g_distribution;
-static std::mt19937 g_mt;
+static unsigned int g_seed = 0;
+
+// PCG32 : a 64-bit state, cheap to restart for every sample, unlike the 2.5kB
+// of std::mt19937
+class PCG32 {
+private:
+    uint64_t state_;
+
+    static const uint64_t multiplier = 6364136223846793005ull;
+    static const uint64_t increment = 1442695040888963407ull;
+
+public:
+    PCG32() : state_(0) {
+    }
+
+    void seed(uint64_t seed) {
+	state_ = seed + increment;
+	next();
+    }
+
+    uint32_t next() {
+	uint64_t old = state_;
+	state_ = old * multiplier + increment;
+	uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+	uint32_t rotation = static_cast<uint32_t>(old >> 59);
+	return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+    }
+};
+
+// each thread draws from its own generator, so no locking is needed
+static thread_local PCG32 t_rng;
 
 void initialize_random_system(unsigned int seed) {
-    g_mt = std::mt19937(seed);
-    g_distribution = std::uniform_real_distribution<float>(0.0f, 1.0f);
+    g_seed = seed;
+    t_rng.seed(seed);
     std::cout << "RNG seed : " << seed << "\n";
 }
 
+void seed_random_stream(uint64_t stream) {
+    // mix the stream index, so that neighbouring streams get unrelated seeds
+    uint64_t z = stream + g_seed * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z = z ^ (z >> 31);
+    
+    t_rng.seed(z);
+}
+
 float random_01() {
-    float x;
-    #pragma omp critical
-    {
-        x = g_distribution(g_mt);
-    }
-    return x;
+    // the top 24 bits, as many as a float holds, for values in [0, 1)
+    return (t_rng.next() >> 8) * (1.0f / 16777216.0f);
 }
 
 Vec2 sample_unit_square() {
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <cstdint>
+
 #include "Vec.hpp"
 
 void initialize_random_system(unsigned int seed);
+// Restarts the random numbers of the calling thread from a sequence that
+// only depends on the seed and the stream index
+void seed_random_stream(uint64_t stream);
 float random_01();
 Vec2 sample_unit_square();
 Vec2 sample_unit_disc();
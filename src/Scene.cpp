@@ -11,6 +11,10 @@ bool Scene::ray_intersect(Ray& ray, Intersect& itx) const {
         }
     }
 
+    if (result) {
+	itx.shape->hit_attributes(ray, itx);
+    }
+
     return result;
 }
 
@@ -25,15 +25,9 @@ bool Shape::ray_intersect(const Ray& ray, Intersect& intersect) const {
     bool result = primitive_->ray_intersect(transformed_ray, intersect);
     
     if (result) {
-	intersect.normal = transform_normal(transform_, intersect.normal);
-        intersect.point = transform_point(transform_, transformed_ray.target());
-        intersect.wo = transform_vector(transform_, -transformed_ray.d);
         intersect.shape = this;
         intersect.material = material_;
 
-	intersect.normal.normalize();
-	intersect.wo.normalize();
-
 	ray.tmax = transformed_ray.tmax;
 	assert(ray.tmax < INFTY);
     }
@@ -41,6 +35,19 @@ bool Shape::ray_intersect(const Ray& ray, Intersect& intersect) const {
     return result;
 }
 
+void Shape::hit_attributes(const Ray& ray, Intersect& intersect) const {
+    // distances along the ray are the same in the space of the primitive
+    Ray transformed_ray = transform_ray(transform_.inverse(), ray);
+    primitive_->hit_attributes(transformed_ray, intersect);
+
+    intersect.normal = transform_normal(transform_, intersect.normal);
+    intersect.point = transform_point(transform_, transformed_ray.target());
+    intersect.wo = transform_vector(transform_, -transformed_ray.d);
+
+    intersect.normal.normalize();
+    intersect.wo.normalize();
+}
+
 bool Shape::ray_intersect(const Ray& ray) const {
     Ray transformed_ray = transform_ray(transform_.inverse(), ray);
     
@@ -9,7 +9,10 @@ public:
     virtual ~Primitive();
     
     virtual bool ray_intersect(const Ray& ray) const = 0;
+    // Records the hit in intersect, without its shading attributes
     virtual bool ray_intersect(const Ray& ray, Intersect& intersect) const = 0;
+    // Normal of the hit recorded by ray_intersect, at ray.tmax
+    virtual void hit_attributes(const Ray& ray, Intersect& intersect) const = 0;
     virtual Vec3 sample(float& pdf) const = 0;
     virtual void print() const;
     virtual float area() const = 0;
@@ -26,8 +29,13 @@ public:
 
     const Primitive* primitive() const;
     const Material* material() const;
+    // Records the hit in intersect, without its shading attributes, as a
+    // later shape may still be closer
     bool ray_intersect(const Ray& ray, Intersect& intersect) const;
     bool ray_intersect(const Ray& ray) const;
+    // Point, normal and outgoing direction of the hit recorded on this shape,
+    // at ray.tmax
+    void hit_attributes(const Ray& ray, Intersect& intersect) const;
 
     void set_transform(const Transform& transform);
     void set_transform(Transform&& transform);
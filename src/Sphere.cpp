@@ -73,14 +73,13 @@ bool Sphere::ray_intersect(const Ray& ray, Intersect& intersect) const {
         }
     }
 
-    if (hit) {
-        Vec3 point = ray.target();
-        intersect.normal = (point - center_) / radius_;
-    }
-
     return hit;
 }
 
+void Sphere::hit_attributes(const Ray& ray, Intersect& intersect) const {
+    intersect.normal = (ray.target() - center_) / radius_;
+}
+
 Vec3 Sphere::sample(float& pdf) const {
     pdf = 1.0f / (4.0f * M_PI * radius_ * radius_);
 
@@ -13,6 +13,7 @@ public:
 
     virtual bool ray_intersect(const Ray& ray) const override;
     virtual bool ray_intersect(const Ray& ray, Intersect& intersect) const override;
+    virtual void hit_attributes(const Ray& ray, Intersect& intersect) const override;
     virtual Vec3 sample(float& pdf) const override;
     virtual void print() const override;
     virtual float area() const override;
@@ -0,0 +1,167 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <limits>
+
+static const size_t outside_thread = std::numeric_limits<size_t>::max();
+static thread_local size_t t_thread_index = outside_thread;
+
+ThreadPool::TaskGroup::TaskGroup()
+    : pending_(0) {
+}
+
+ThreadPool::ThreadPool(size_t thread_count)
+    : stop_(false), queued_(0) {
+    if (thread_count == 0) {
+	thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < thread_count + 1; i++) {
+	queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+	threads_.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+	std::lock_guard<std::mutex> lock(sleep_mtx_);
+	stop_ = true;
+    }
+    wake_.notify_all();
+
+    for (std::thread& thread : threads_) {
+	thread.join();
+    }
+}
+
+size_t ThreadPool::thread_count() const {
+    return threads_.size();
+}
+
+size_t ThreadPool::thread_index() {
+    return t_thread_index;
+}
+
+size_t ThreadPool::queue_index() const {
+    return t_thread_index == outside_thread ? threads_.size() : t_thread_index;
+}
+
+void ThreadPool::submit(TaskGroup& group, Task task) {
+    group.pending_++;
+
+    // counted before being pushed, so that the count never goes below zero
+    {
+	std::lock_guard<std::mutex> lock(sleep_mtx_);
+	queued_++;
+    }
+
+    Queue& queue = *queues_[queue_index()];
+    {
+	std::lock_guard<std::mutex> lock(queue.mtx);
+	queue.tasks.push_back(std::make_pair(std::move(task), &group));
+    }
+    
+    wake_.notify_one();
+}
+
+// Runs a task from the back of the calling thread's queue, or stolen from
+// the front of another queue
+bool ThreadPool::run_one() {
+    size_t own = queue_index();
+    std::pair<Task, TaskGroup*> item;
+    bool found = false;
+
+    for (size_t i = 0; i < queues_.size() && !found; i++) {
+	Queue& queue = *queues_[(own + i) % queues_.size()];
+
+	std::lock_guard<std::mutex> lock(queue.mtx);
+	if (!queue.tasks.empty()) {
+	    if (i == 0) {
+		item = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+	    } else {
+		item = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+	    }
+	    found = true;
+	}
+    }
+
+    if (!found) {
+	return false;
+    }
+    queued_--;
+
+    TaskGroup& group = *item.second;
+    try {
+	item.first();
+    } catch (...) {
+	std::lock_guard<std::mutex> lock(group.exception_mtx_);
+	if (!group.exception_) {
+	    group.exception_ = std::current_exception();
+	}
+    }
+    // the group may be destroyed as soon as its last task is done
+    if (--group.pending_ == 0) {
+	{
+	    std::lock_guard<std::mutex> lock(sleep_mtx_);
+	}
+	wake_.notify_all();
+    }
+
+    return true;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    t_thread_index = index;
+
+    while (true) {
+	if (run_one()) {
+	    continue;
+	}
+
+	std::unique_lock<std::mutex> lock(sleep_mtx_);
+	wake_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+	if (stop_) {
+	    return;
+	}
+    }
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    while (group.pending_ > 0) {
+	if (run_one()) {
+	    continue;
+	}
+
+	// the remaining tasks are running on other threads
+	std::unique_lock<std::mutex> lock(sleep_mtx_);
+	wake_.wait(lock, [this, &group]() { return group.pending_ == 0 || queued_ > 0; });
+    }
+
+    if (group.exception_) {
+	std::exception_ptr exception = group.exception_;
+	group.exception_ = nullptr;
+	std::rethrow_exception(exception);
+    }
+}
+
+void ThreadPool::parallel_for(size_t begin, size_t end, const std::function<void(size_t)>& f, size_t grain) {
+    TaskGroup group;
+    grain = std::max<size_t>(grain, 1);
+
+    for (size_t chunk = begin; chunk < end; chunk += grain) {
+	size_t chunk_end = std::min(chunk + grain, end);
+
+	submit(group, [&f, chunk, chunk_end]() {
+		for (size_t i = chunk; i < chunk_end; i++) {
+		    f(i);
+		}
+	    });
+    }
+
+    wait(group);
+}
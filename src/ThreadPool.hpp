@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads executing tasks.
+// Each worker pops tasks from the back of its own deque, and steals from the
+// front of the others' once it runs out. A thread waiting for a group of tasks
+// executes pending tasks in the meantime, so tasks can submit and wait for
+// nested tasks without deadlocking.
+// Besides the workers, a single outside thread at a time may use the pool.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    // Tasks that can be waited for together
+    class TaskGroup {
+    private:
+	std::atomic<size_t> pending_;
+	std::mutex exception_mtx_;
+	std::exception_ptr exception_;
+
+	friend class ThreadPool;
+
+    public:
+	TaskGroup();
+    };
+
+private:
+    struct Queue {
+	std::mutex mtx;
+	std::deque<std::pair<Task, TaskGroup*>> tasks;
+    };
+
+    // one per worker, and one for the outside thread
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::atomic<bool> stop_;
+    std::atomic<size_t> queued_;
+    std::mutex sleep_mtx_;
+    std::condition_variable wake_;
+
+    ThreadPool& operator=(const ThreadPool& other);
+    ThreadPool(const ThreadPool& other);
+
+    size_t queue_index() const;
+    bool run_one();
+    void worker_loop(size_t index);
+
+public:
+    // 0 threads uses one per hardware thread
+    explicit ThreadPool(size_t thread_count=0);
+    ~ThreadPool();
+
+    void submit(TaskGroup& group, Task task);
+
+    // Rethrows the first exception thrown by the tasks of the group
+    void wait(TaskGroup& group);
+
+    // Calls f(i) for every i in [begin, end), grain indices per task
+    void parallel_for(size_t begin, size_t end, const std::function<void(size_t)>& f, size_t grain=1);
+
+    size_t thread_count() const;
+
+    // Index of the calling thread among the workers, or thread_count() for
+    // a thread outside the pool ; useful to index per-thread storage
+    static size_t thread_index();
+};
@@ -0,0 +1,232 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// Position of (x, y) along the Hilbert curve filling an n x n grid, n being a
+// power of two
+static size_t hilbert_index(size_t n, size_t x, size_t y) {
+    size_t d = 0;
+
+    for (size_t s = n / 2; s > 0; s /= 2) {
+	size_t rx = (x & s) > 0;
+	size_t ry = (y & s) > 0;
+	d += s * s * ((3 * rx) ^ ry);
+
+	// rotate the quadrant
+	if (ry == 0) {
+	    if (rx == 1) {
+		x = n - 1 - x;
+		y = n - 1 - y;
+	    }
+	    std::swap(x, y);
+	}
+    }
+
+    return d;
+}
+
+std::vector<Tile> make_tiles(size_t width, size_t height, size_t tile_size) {
+    size_t columns = (width + tile_size - 1) / tile_size;
+    size_t rows = (height + tile_size - 1) / tile_size;
+
+    size_t n = 1;
+    while (n < columns || n < rows) {
+	n *= 2;
+    }
+
+    std::vector<std::pair<size_t, Tile>> indexed_tiles;
+    for (size_t row = 0; row < rows; row++) {
+	for (size_t col = 0; col < columns; col++) {
+	    Tile tile;
+	    tile.rowmin = row * tile_size;
+	    tile.rowmax = std::min(tile.rowmin + tile_size, height);
+	    tile.colmin = col * tile_size;
+	    tile.colmax = std::min(tile.colmin + tile_size, width);
+
+	    indexed_tiles.push_back(std::make_pair(hilbert_index(n, col, row), tile));
+	}
+    }
+
+    std::sort(indexed_tiles.begin(), indexed_tiles.end(),
+	      [](const std::pair<size_t, Tile>& a, const std::pair<size_t, Tile>& b) {
+		  return a.first < b.first;
+	      });
+
+    std::vector<Tile> tiles;
+    for (const auto& p : indexed_tiles) {
+	tiles.push_back(p.second);
+    }
+
+    return tiles;
+}
+
+std::vector<Tile> clip_tiles(const std::vector<Tile>& tiles, const std::vector<Tile>& regions) {
+    std::vector<Tile> clipped_tiles;
+    for (const Tile& tile : tiles) {
+	Tile clipped = {tile.rowmax, tile.rowmin, tile.colmax, tile.colmin};
+	for (const Tile& region : regions) {
+	    size_t rowmin = std::max(tile.rowmin, region.rowmin);
+	    size_t rowmax = std::min(tile.rowmax, region.rowmax);
+	    size_t colmin = std::max(tile.colmin, region.colmin);
+	    size_t colmax = std::min(tile.colmax, region.colmax);
+	    if (rowmin < rowmax && colmin < colmax) {
+		clipped.rowmin = std::min(clipped.rowmin, rowmin);
+		clipped.rowmax = std::max(clipped.rowmax, rowmax);
+		clipped.colmin = std::min(clipped.colmin, colmin);
+		clipped.colmax = std::max(clipped.colmax, colmax);
+	    }
+	}
+
+	if (clipped.rowmin < clipped.rowmax) {
+	    clipped_tiles.push_back(clipped);
+	}
+    }
+
+    return clipped_tiles;
+}
+
+std::vector<std::vector<size_t>> tile_neighbourhoods(const std::vector<Tile>& tiles, size_t tile_size) {
+    size_t columns = 0;
+    size_t rows = 0;
+    for (const Tile& tile : tiles) {
+	columns = std::max(columns, tile.colmin / tile_size + 1);
+	rows = std::max(rows, tile.rowmin / tile_size + 1);
+    }
+
+    // some cells may have no tile, once tiles are clipped
+    const size_t none = tiles.size();
+    std::vector<size_t> grid(rows * columns, none);
+    for (size_t i = 0; i < tiles.size(); i++) {
+	grid[tiles[i].rowmin / tile_size * columns + tiles[i].colmin / tile_size] = i;
+    }
+
+    std::vector<std::vector<size_t>> neighbourhoods(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++) {
+	size_t row = tiles[i].rowmin / tile_size;
+	size_t col = tiles[i].colmin / tile_size;
+
+	for (size_t r = row > 0 ? row - 1 : 0; r <= row + 1 && r < rows; r++) {
+	    for (size_t c = col > 0 ? col - 1 : 0; c <= col + 1 && c < columns; c++) {
+		if (grid[r * columns + c] != none) {
+		    neighbourhoods[i].push_back(grid[r * columns + c]);
+		}
+	    }
+	}
+	std::sort(neighbourhoods[i].begin(), neighbourhoods[i].end());
+    }
+
+    return neighbourhoods;
+}
+
+float area_average(const std::vector<Tile>& tiles, const std::vector<float>& values) {
+    double sum = 0.0;
+    size_t area = 0;
+    for (size_t i = 0; i < tiles.size(); i++) {
+	size_t tile_area = (tiles[i].rowmax - tiles[i].rowmin) * (tiles[i].colmax - tiles[i].colmin);
+	sum += static_cast<double>(values[i]) * tile_area;
+	area += tile_area;
+    }
+    return area > 0 ? static_cast<float>(sum / area) : 0.0f;
+}
+
+static const uint64_t field_mask = (1 << 20) - 1;
+static const uint64_t max_pass = (1 << 24) - 1;
+
+static uint64_t pack_state(uint64_t pass, uint64_t begin, uint64_t end) {
+    return (pass << 40) | (begin << 20) | end;
+}
+
+static uint64_t state_pass(uint64_t state) {
+    return state >> 40;
+}
+
+static bool state_empty(uint64_t state) {
+    return ((state >> 20) & field_mask) >= (state & field_mask);
+}
+
+// Takes a tile from the front or the back of a worker's range, if the worker
+// is at most at a given pass
+static bool take(std::atomic<uint64_t>& state, bool from_back, uint64_t last_pass,
+		 size_t& tile, size_t& pass) {
+    uint64_t s = state.load();
+
+    while (true) {
+	uint64_t p = state_pass(s);
+	uint64_t begin = (s >> 20) & field_mask;
+	uint64_t end = s & field_mask;
+	if (begin >= end || p > last_pass) {
+	    return false;
+	}
+
+	uint64_t new_s = from_back ? pack_state(p, begin, end - 1) : pack_state(p, begin + 1, end);
+	if (state.compare_exchange_weak(s, new_s)) {
+	    tile = from_back ? end - 1 : begin;
+	    pass = p;
+	    return true;
+	}
+    }
+}
+
+TileScheduler::TileScheduler(size_t tile_count, size_t pass_count, size_t worker_count)
+    : states_(std::max<size_t>(worker_count, 1)), tile_count_(tile_count),
+      pass_count_(std::min<uint64_t>(pass_count, max_pass)) {
+    if (tile_count > field_mask) {
+	throw std::invalid_argument("Too many tiles");
+    }
+    
+    for (size_t i = 0; i < states_.size(); i++) {
+	states_[i].store(pass_count_ > 0 ? owned_range(i, 0) : 0);
+    }
+}
+
+uint64_t TileScheduler::owned_range(size_t worker, size_t pass) const {
+    return pack_state(pass,
+		      tile_count_ * worker / states_.size(),
+		      tile_count_ * (worker + 1) / states_.size());
+}
+
+bool TileScheduler::advance(size_t worker) {
+    uint64_t s = states_[worker].load();
+    if (!state_empty(s) || state_pass(s) + 1 >= pass_count_) {
+	return false;
+    }
+
+    // fails if another worker advanced the range first, which is fine too
+    states_[worker].compare_exchange_strong(s, owned_range(worker, state_pass(s) + 1));
+    return true;
+}
+
+bool TileScheduler::next(size_t worker, size_t& tile, size_t& pass) {
+    while (true) {
+	uint64_t current_pass = state_pass(states_[worker].load());
+	
+	if (take(states_[worker], false, current_pass, tile, pass)) {
+	    return true;
+	}
+
+	// help the workers which are not further along, starting from the end
+	// of their range, which is far from where their owner is working
+	for (size_t i = 1; i < states_.size(); i++) {
+	    if (take(states_[(worker + i) % states_.size()], true, current_pass, tile, pass)) {
+		return true;
+	    }
+	}
+
+	if (advance(worker)) {
+	    continue;
+	}
+
+	// done with the last pass : move the workers lagging behind to their
+	// next pass, to share it
+	bool advanced = false;
+	for (size_t i = 1; i < states_.size(); i++) {
+	    advanced = advance((worker + i) % states_.size()) || advanced;
+	}
+	
+	if (!advanced) {
+	    return false;
+	}
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Rectangle of pixels in rows [rowmin, rowmax) and columns [colmin, colmax)
+struct Tile {
+    size_t rowmin;
+    size_t rowmax;
+    size_t colmin;
+    size_t colmax;
+};
+
+// Splits an image into square tiles, listed along a Hilbert curve so that
+// consecutive tiles are neighbours
+std::vector<Tile> make_tiles(size_t width, size_t height, size_t tile_size);
+
+// Shrinks each tile to the bounding box of its intersections with regions,
+// dropping the tiles outside every region. The tiles keep their place in the
+// grid of make_tiles.
+std::vector<Tile> clip_tiles(const std::vector<Tile>& tiles, const std::vector<Tile>& regions);
+
+// Tiles whose film tiles may overlap each one's, itself included, as sorted
+// lists of indices in tiles
+std::vector<std::vector<size_t>> tile_neighbourhoods(const std::vector<Tile>& tiles, size_t tile_size);
+
+// Mean of values given for each tile, weighted by the areas of the tiles : the
+// mean over the pixels they cover, clipped tiles included
+float area_average(const std::vector<Tile>& tiles, const std::vector<float>& values);
+
+// Distributes (tile, pass) work items among workers, without any barrier
+// between passes.
+// Each worker owns a contiguous range of tiles, which it renders pass after
+// pass. Once it has taken all of its tiles for a pass, a worker steals the
+// tiles left to workers lagging behind before moving on to the next pass,
+// which keeps the workers about one pass apart. Workers done with the last
+// pass share the remaining passes of the others.
+class TileScheduler {
+private:
+    // range of tiles left to each worker, and the pass it is at, packed as
+    // pass << 40 | begin << 20 | end
+    std::vector<std::atomic<uint64_t>> states_;
+    size_t tile_count_;
+    size_t pass_count_;
+
+    TileScheduler& operator=(const TileScheduler& other);
+    TileScheduler(const TileScheduler& other);
+
+    uint64_t owned_range(size_t worker, size_t pass) const;
+    // Moves a worker whose range is empty to its next pass
+    bool advance(size_t worker);
+
+public:
+    TileScheduler(size_t tile_count, size_t pass_count, size_t worker_count);
+
+    // Gives the next item to process, or returns false once all are taken
+    bool next(size_t worker, size_t& tile, size_t& pass);
+};
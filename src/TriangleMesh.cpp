@@ -54,10 +54,8 @@ bool triangle_ray_intersect(const Triangle& triangle, const Ray& ray, Intersect&
     // On calcule t pour savoir ou le point d'intersection se situe sur la ligne.
     float t = f * dot(edge2, q);
     if (t > 0.0f && t < ray.tmax) {
-        intersect.normal =
-            (u * (triangle.normals[1])
-             + v * (triangle.normals[2])
-             + (1.0f - u - v) * (triangle.normals[0])).normalized();
+	intersect.u = u;
+	intersect.v = v;
 	ray.tmax = t;
         return true;
     } else {
@@ -194,6 +192,9 @@ bool bvh_intersect(const TriangleMesh& mesh,
                                               ray,
                                               itx
                                               );
+	    if (hit) {
+		itx.primitive = idx;
+	    }
 	    any_hit = any_hit || hit;
         }
 	assert(!any_hit || ray.tmax < INFTY);
@@ -222,6 +223,17 @@ bool TriangleMesh::ray_intersect(const Ray& ray, Intersect& intersect) const {
     return result;
 }
 
+void TriangleMesh::hit_attributes(const Ray& ray, Intersect& intersect) const {
+    const Triangle& tri = triangle(intersect.primitive);
+    float u = intersect.u;
+    float v = intersect.v;
+
+    intersect.normal =
+	(u * (tri.normals[1])
+	 + v * (tri.normals[2])
+	 + (1.0f - u - v) * (tri.normals[0])).normalized();
+}
+
 Vec3 TriangleMesh::sample(float& pdf) const {
     pdf = 1.0f / total_area_;
 
@@ -36,6 +36,7 @@ public:
     
     virtual bool ray_intersect(const Ray& ray) const override;
     virtual bool ray_intersect(const Ray& ray, Intersect& intersect) const;
+    virtual void hit_attributes(const Ray& ray, Intersect& intersect) const override;
     virtual Vec3 sample(float& pdf) const;
     virtual float area() const override;
 
@@ -219,3 +219,54 @@ Vec<T, N> Vec<T, N>::normalized() const {
     return result;
 }
 
+
+#ifdef __SSE__
+// Vec4 fills an SSE register : its arithmetic works on the whole register,
+// and gives the same results as the loops above
+#include <xmmintrin.h>
+
+template<>
+inline const Vec<float, 4>& Vec<float, 4>::operator+=(const Vec<float, 4>& other) {
+    _mm_storeu_ps(co_, _mm_add_ps(_mm_loadu_ps(co_), _mm_loadu_ps(other.co_)));
+    assert(!has_nan(*this));
+    return *this;
+}
+
+template<>
+inline const Vec<float, 4>& Vec<float, 4>::operator-=(const Vec<float, 4>& other) {
+    _mm_storeu_ps(co_, _mm_sub_ps(_mm_loadu_ps(co_), _mm_loadu_ps(other.co_)));
+    assert(!has_nan(*this));
+    return *this;
+}
+
+template<>
+inline const Vec<float, 4>& Vec<float, 4>::operator*=(const float& other) {
+    _mm_storeu_ps(co_, _mm_mul_ps(_mm_loadu_ps(co_), _mm_set1_ps(other)));
+    assert(!has_nan(*this));
+    return *this;
+}
+
+template<>
+inline const Vec<float, 4>& Vec<float, 4>::operator/=(const float& other) {
+    for (size_t i = 0; i < 4; i++) {
+        assert(!(other == 0 && co_[i] == 0));
+    }
+    _mm_storeu_ps(co_, _mm_div_ps(_mm_loadu_ps(co_), _mm_set1_ps(other)));
+    assert(!has_nan(*this));
+    return *this;
+}
+
+template<>
+inline float dot(const Vec<float, 4>& lhs, const Vec<float, 4>& rhs) {
+    assert(!has_nan(lhs) && !has_nan(rhs));
+    __m128 products = _mm_mul_ps(_mm_loadu_ps(&lhs[0]), _mm_loadu_ps(&rhs[0]));
+
+    // summed in the order of the generic loop
+    __m128 sum = _mm_add_ss(_mm_setzero_ps(), products);
+    for (int i = 1; i < 4; i++) {
+	products = _mm_shuffle_ps(products, products, _MM_SHUFFLE(0, 3, 2, 1));
+	sum = _mm_add_ss(sum, products);
+    }
+    return _mm_cvtss_f32(sum);
+}
+#endif
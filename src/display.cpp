@@ -16,11 +16,21 @@ void blit_fit(SDL_Surface* src, SDL_Surface* dst) {
 }
 
 void draw_image(const Buffer2D<RGB8>& image, SDL_Surface* surface, size_t dx, size_t dy) {
+    // RGB888 pixels are RGB8::packed, other formats are mapped by SDL
+    bool packed = surface->format->format == SDL_PIXELFORMAT_RGB888;
+
     for (size_t row = 0; row < image.rows(); row++) {
-	for (size_t col = 0; col < image.columns(); col++) {
-	    RGB8 pixel8 = image(row, col);
-	    uint32_t* surface_pixel = ((uint32_t*)surface->pixels) + (row + dy) * surface->w + col + dx;
-	    *surface_pixel = SDL_MapRGB(surface->format, pixel8.r, pixel8.g, pixel8.b);
+	uint32_t* surface_row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(surface->pixels)
+							    + (row + dy) * surface->pitch) + dx;
+	const RGB8* pixels = &image(row, 0);
+	if (packed) {
+	    for (size_t col = 0; col < image.columns(); col++) {
+		surface_row[col] = pixels[col].packed();
+	    }
+	} else {
+	    for (size_t col = 0; col < image.columns(); col++) {
+		surface_row[col] = SDL_MapRGB(surface->format, pixels[col].r, pixels[col].g, pixels[col].b);
+	    }
 	}
     }
 }
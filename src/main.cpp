@@ -1,13 +1,22 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <cmath>
 #include <cassert>
 #include <sstream>
 #include <chrono>
 #include <limits>
+#include <map>
 #include <iomanip>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <csignal>
 
+#ifdef WITH_SDL
 #include <SDL2/SDL.h>
+#endif
 #include <ANN/ANN.h>
 
 #include "Vec.hpp"
@@ -25,38 +34,177 @@
 #include "BVH.hpp"
 #include "LightTree.hpp"
 #include "TOMLParser.hpp"
+#include "PathRadianceStore.hpp"
+#include "TileScheduler.hpp"
+#include "ThreadPool.hpp"
+#include "Preview.hpp"
+#include "Checkpoint.hpp"
 #include "util.hpp"
+#ifdef WITH_SDL
 #include "display.hpp"
+#endif
 
 struct Options {
     size_t width;
     size_t height;
+    // samples [first_sample, sample_count) are rendered in every pixel
+    size_t first_sample;
     size_t sample_count;
+    // the unnormalized film is written too, for merging
+    bool write_film;
     size_t max_bounces;
     float filter_radius;
+    FilterType filter_type;
+
+    // 0 uses one thread per hardware thread
+    size_t thread_count;
+    size_t tile_size;
+    // samples per pixel rendered each time a thread picks a tile
+    size_t tile_samples;
+
+    // relative error under which pixels stop being sampled, 0 to disable
+    float adaptive_threshold;
+    // samples taken in every pixel before the error is estimated
+    size_t adaptive_min_samples;
+
+    // stop criteria besides the sample count, 0 to disable : rendering time
+    // in seconds, and average relative error of the pixels
+    double time_limit;
+    float target_noise;
 
     unsigned int seed;
 
+    // renders without the preview window, and without initializing SDL
+    bool headless;
+    // most frames per second published to the preview window
+    float preview_fps;
+    // previews the image at lower resolutions before the first sample pass
+    bool progressive_preview;
+    // distance the camera moves by per key press in the preview window
+    float camera_step;
+
     std::string output_base;
+    // linear images written besides the PNGs : "pfm", "exr", or none if empty
+    std::string hdr_format;
+    // of the PNGs and the preview, in stops, and their tone curve
+    float exposure;
+    ToneMapper::Curve tone_curve;
 
     std::string scene_file;
 
     std::vector<LightPathExpression> light_paths;
+
+    // longest paths recorded in the path store, 0 to disable it
+    size_t path_store_length;
+    // path store to evaluate the light paths from, instead of rendering
+    std::string query_file;
+
+    // seconds between checkpoints, 0 to disable them
+    double checkpoint_interval;
+    // checkpoint to continue rendering from
+    std::string resume_file;
+
+    // pixels rendered instead of the whole image, as rectangles
+    std::vector<Tile> regions;
+    // output base of a render the regions are pasted into, instead of being
+    // written cropped to their bounding box
+    std::string composite_base;
+
+    // keeps half-float means and no pixel statistics in the film : 6 bytes
+    // per layer and 4 per pixel, instead of 12 per layer and 16 per pixel
+    bool compact_film;
+
+    // renders tile rows to completion one after the other, writing the
+    // images as they are done, to hold only part of the film
+    bool streaming;
+
+    // films rendered from sample ranges to merge, instead of rendering
+    bool merge;
+    std::vector<std::string> merge_files;
 };
 
 void print_usage_string() {
-    std::cerr << "Usage : ./renderer [-w width] [-h height] [-s sample_count] scene_file [light paths...]\n";
+    std::cerr << "Usage : ./renderer [-w width] [-h height] [-s sample_count] [--headless] [--progressive-preview]\n"
+	      << "                  [--time-limit seconds] [--target-noise relative_error]\n"
+	      << "                  [--checkpoint-interval seconds] [--resume checkpoint_file]\n"
+	      << "                  [--sample-range first:end] [--crop x0,y0,x1,y1] [--tiles i,j,...]\n"
+	      << "                  [--composite previous_output_base] [--streaming] [--compact-film]\n"
+	      << "                  [--hdr pfm|exr] [--exposure stops] [--tone-curve clamp|filmic]\n"
+	      << "                  scene_file [light paths...]\n"
+	      << "        ./renderer --query path_store_file [-o output_base] [--hdr pfm|exr] [light paths...]\n"
+	      << "        ./renderer [-o output_base] [--hdr pfm|exr] --merge film_files...\n";
+}
+
+// light paths the integrator must trace : the requested ones, and every path
+// short enough to be recorded in the path store
+std::vector<LightPathExpression> traced_light_paths(const Options& options) {
+    std::vector<LightPathExpression> light_paths = options.light_paths;
+
+    std::string any;
+    for (size_t i = 0; i < options.path_store_length; i++) {
+	any += '.';
+	light_paths.push_back(LightPathExpression(any));
+    }
+
+    return light_paths;
+}
+
+// Comma separated values
+std::vector<size_t> parse_list(const std::string& s) {
+    std::vector<size_t> values;
+    std::stringstream sstream(s);
+    std::string value;
+    while (std::getline(sstream, value, ',')) {
+	values.push_back(parse<size_t>(value));
+    }
+    return values;
+}
+
+// Size of the tiles rendered : at least twice the apron of the film tiles,
+// which then only overlap the neighbouring tiles
+size_t render_tile_size(const Options& options) {
+    size_t apron = static_cast<size_t>(std::ceil(options.filter_radius));
+    return std::max(options.tile_size, 2 * apron);
 }
 
 Options parse_options(int argc, char** argv) {
     Options options;
     options.width = 512;
     options.height = 512;
+    options.first_sample = 0;
+    options.write_film = false;
     options.sample_count = std::numeric_limits<size_t>::max();
     options.max_bounces = 3;
     options.filter_radius = 1.5f;
+    options.filter_type = MITCHELL;
+    options.thread_count = 0;
+    options.tile_size = 32;
+    options.tile_samples = 1;
+    options.adaptive_threshold = 0.0f;
+    options.adaptive_min_samples = 16;
+    options.time_limit = 0.0;
+    options.target_noise = 0.0f;
+#ifdef WITH_SDL
+    options.headless = false;
+#else
+    options.headless = true;
+#endif
+    options.preview_fps = 10.0f;
+    options.progressive_preview = false;
+    options.camera_step = 0.1f;
     options.output_base = "out" + timestamp();
+    options.exposure = 0.0f;
+    options.tone_curve = ToneMapper::CLAMP;
     options.seed = time(NULL);
+    options.path_store_length = 0;
+    options.checkpoint_interval = 0.0;
+    options.compact_film = false;
+    options.streaming = false;
+    options.merge = false;
+
+    // numbered row by row, in the tiles of the render
+    std::vector<size_t> region_tiles;
+    bool seed_given = false;
 
     int i = 1;
     for (i = 1; i < argc; i += 2) {
@@ -64,6 +212,18 @@ Options parse_options(int argc, char** argv) {
         
         if (option == "-s") {
             options.sample_count = parse<size_t>(argv[i+1]);
+	} else if (option == "--sample-range") {
+	    std::string range(argv[i+1]);
+	    size_t colon = range.find(':');
+	    if (colon == std::string::npos) {
+		throw std::invalid_argument("Sample ranges are given as first:end");
+	    }
+	    options.first_sample = parse<size_t>(range.substr(0, colon));
+	    options.sample_count = parse<size_t>(range.substr(colon + 1));
+	    if (options.first_sample >= options.sample_count) {
+		throw std::invalid_argument("Empty sample range " + range);
+	    }
+	    options.write_film = true;
         } else if (option == "-w") {
             options.width = parse<size_t>(argv[i+1]);
         } else if (option == "-h") {
@@ -72,16 +232,125 @@ Options parse_options(int argc, char** argv) {
 	    options.max_bounces = parse<size_t>(argv[i+1]);
         } else if (option == "--filter-radius") {
 	    options.filter_radius = parse<float>(argv[i+1]);
+	} else if (option == "--filter") {
+	    options.filter_type = parse_filter_type(argv[i+1]);
+	} else if (option == "--threads") {
+	    options.thread_count = parse<size_t>(argv[i+1]);
+	} else if (option == "--tile-size") {
+	    options.tile_size = std::max<size_t>(1, parse<size_t>(argv[i+1]));
+	} else if (option == "--tile-samples") {
+	    options.tile_samples = std::max<size_t>(1, parse<size_t>(argv[i+1]));
+	} else if (option == "--adaptive-threshold") {
+	    options.adaptive_threshold = parse<float>(argv[i+1]);
+	} else if (option == "--adaptive-min-samples") {
+	    options.adaptive_min_samples = std::max<size_t>(2, parse<size_t>(argv[i+1]));
+	} else if (option == "--time-limit") {
+	    options.time_limit = parse<double>(argv[i+1]);
+	} else if (option == "--target-noise") {
+	    options.target_noise = parse<float>(argv[i+1]);
         } else if (option == "--seed") {
 	    options.seed = parse<unsigned int>(argv[i+1]);
+	    seed_given = true;
 	} else if (option == "-o") {
 	    options.output_base = parse<std::string>(argv[i+1]);
+	} else if (option == "--hdr") {
+	    options.hdr_format = parse<std::string>(argv[i+1]);
+	    if (options.hdr_format != "pfm" && options.hdr_format != "exr") {
+		throw std::invalid_argument("HDR images are written as pfm or exr");
+	    }
+	} else if (option == "--exposure") {
+	    options.exposure = parse<float>(argv[i+1]);
+	} else if (option == "--tone-curve") {
+	    options.tone_curve = parse_tone_curve(argv[i+1]);
+	} else if (option == "--path-store") {
+	    options.path_store_length = parse<size_t>(argv[i+1]);
+	} else if (option == "--query") {
+	    options.query_file = parse<std::string>(argv[i+1]);
+	} else if (option == "--checkpoint-interval") {
+	    options.checkpoint_interval = parse<double>(argv[i+1]);
+	} else if (option == "--resume") {
+	    options.resume_file = parse<std::string>(argv[i+1]);
+	} else if (option == "--crop") {
+	    std::vector<size_t> corners = parse_list(argv[i+1]);
+	    if (corners.size() != 4 || corners[0] >= corners[2] || corners[1] >= corners[3]) {
+		throw std::invalid_argument("Crop windows are given as x0,y0,x1,y1");
+	    }
+	    Tile region;
+	    region.colmin = corners[0];
+	    region.rowmin = corners[1];
+	    region.colmax = corners[2];
+	    region.rowmax = corners[3];
+	    options.regions.push_back(region);
+	} else if (option == "--tiles") {
+	    std::vector<size_t> tiles = parse_list(argv[i+1]);
+	    region_tiles.insert(region_tiles.end(), tiles.begin(), tiles.end());
+	} else if (option == "--composite") {
+	    options.composite_base = parse<std::string>(argv[i+1]);
+	} else if (option == "--preview-fps") {
+	    options.preview_fps = std::max(0.1f, parse<float>(argv[i+1]));
+	} else if (option == "--camera-step") {
+	    options.camera_step = parse<float>(argv[i+1]);
+	} else if (option == "--progressive-preview") {
+	    options.progressive_preview = true;
+	    // takes no value
+	    i--;
+	} else if (option == "--compact-film") {
+	    options.compact_film = true;
+	    // takes no value
+	    i--;
+	} else if (option == "--streaming") {
+	    options.streaming = true;
+	    options.headless = true;
+	    // takes no value
+	    i--;
+	} else if (option == "--merge") {
+	    options.merge = true;
+	    // takes no value
+	    i--;
+	} else if (option == "--headless") {
+	    options.headless = true;
+	    // takes no value
+	    i--;
 	} else {
 	    break;
 	}
     }
 
-    if (i < argc) {
+    // the tiles the render splits the image into
+    size_t tile_size = render_tile_size(options);
+    size_t tile_columns = (options.width + tile_size - 1) / tile_size;
+    size_t tile_rows = (options.height + tile_size - 1) / tile_size;
+    for (size_t tile : region_tiles) {
+	if (tile >= tile_columns * tile_rows) {
+	    throw std::invalid_argument("No tile " + std::to_string(tile) + " in the image");
+	}
+	Tile region;
+	region.rowmin = tile / tile_columns * tile_size;
+	region.rowmax = std::min(region.rowmin + tile_size, options.height);
+	region.colmin = tile % tile_columns * tile_size;
+	region.colmax = std::min(region.colmin + tile_size, options.width);
+	options.regions.push_back(region);
+    }
+
+    for (const Tile& region : options.regions) {
+	if (region.rowmax > options.height || region.colmax > options.width) {
+	    throw std::invalid_argument("The crop window exceeds the image");
+	}
+    }
+
+    if (options.merge) {
+	// the remaining arguments are the films
+	options.merge_files.assign(argv + i, argv + argc);
+	if (options.merge_files.empty()) {
+	    print_usage_string();
+	    exit(1);
+	}
+	return options;
+    }
+
+    if (!options.query_file.empty()) {
+	// no scene needed
+    } else if (i < argc) {
 	options.scene_file = parse<std::string>(argv[i]);
 	i++;
     } else {
@@ -99,23 +368,105 @@ Options parse_options(int argc, char** argv) {
 	options.light_paths.push_back(LightPathExpression("L*E"));
     }
 
+    // the films of other ranges must be rendered with the same seed
+    if (options.write_film && !seed_given) {
+	std::cerr << "Sample ranges need an explicit --seed\n";
+	exit(1);
+    }
+    // the film must hold the whole range : nothing may stop the render early,
+    // or restart it from another camera
+    if (options.write_film && (!options.headless || options.time_limit > 0.0 || options.target_noise > 0.0f
+			       || options.adaptive_threshold > 0.0f)) {
+	std::cerr << "Sample ranges are rendered --headless, without --time-limit, --target-noise"
+		  << " or adaptive sampling\n";
+	exit(1);
+    }
+
+    if (options.compact_film && (options.adaptive_threshold > 0.0f || options.target_noise > 0.0f)) {
+	std::cerr << "Compact films keep no pixel statistics for adaptive sampling or --target-noise\n";
+	exit(1);
+    }
+
+    if (options.headless && options.query_file.empty() && options.sample_count == std::numeric_limits<size_t>::max()
+	&& options.time_limit <= 0.0 && options.target_noise <= 0.0f) {
+	std::cerr << "Headless rendering needs -s, --time-limit or --target-noise to end\n";
+	exit(1);
+    }
+
+    if (options.streaming && (options.sample_count == std::numeric_limits<size_t>::max()
+			      || options.path_store_length > 0 || options.adaptive_threshold > 0.0f
+			      || options.time_limit > 0.0 || options.target_noise > 0.0f
+			      || options.checkpoint_interval > 0.0 || !options.resume_file.empty()
+			      || !options.regions.empty() || !options.composite_base.empty() || options.write_film)) {
+	std::cerr << "Streaming renders take -s, and no path store, adaptive sampling, stop criteria,"
+		  << " checkpoints, crop windows, composites or sample ranges\n";
+	exit(1);
+    }
+    // the HDR writers take whole images
+    if (options.streaming && !options.hdr_format.empty()) {
+	std::cerr << "Streaming renders write PPM images only, not --hdr " << options.hdr_format << "\n";
+	exit(1);
+    }
+
+    if (options.path_store_length >= PathSignature::max_length) {
+	options.path_store_length = PathSignature::max_length - 1;
+	std::cout << "Limiting stored path length to " << options.path_store_length << "\n";
+    }
+
+    // with n bounces, the last surface hit is the (n + 2)th vertex of a path :
+    // bouncing further can't produce paths matching any of the expressions
+    size_t max_path_length = LightPathAutomaton(traced_light_paths(options)).max_path_length();
+    if (max_path_length < options.max_bounces + 2) {
+	options.max_bounces = max_path_length < 2 ? 0 : max_path_length - 2;
+	std::cout << "Limiting bounces to " << options.max_bounces << "\n";
+    }
+
+    // the eye, the surface hits and a light sample must fit in a PathSignature
+    if (options.max_bounces + 3 > PathSignature::max_length) {
+	options.max_bounces = PathSignature::max_length - 3;
+	std::cout << "Limiting bounces to " << options.max_bounces << "\n";
+    }
+
     return options;
 }
 
-std::vector<LightTree*> trace_ray(const Scene& scene, Ray& ray, size_t max_bounces = 0) {
+// Returns one tree per BRDF of the surface hit by the ray. Branches whose path
+// can't match any light path expression anymore are not traced any further,
+// and are returned as null pointers so that they still count as upstream
+// branches of their parent.
+std::vector<LightTree*> trace_ray(const Scene& scene, Ray& ray,
+				  const LightPathAutomaton& automaton, LightPathAutomaton::State state,
+				  size_t max_bounces = 0) {
     std::vector<LightTree*> results;
     Intersect itx;
     if (scene.ray_intersect(ray, itx)) {
 	itx.setup_local_basis();
-	
+
+	std::vector<LightPathAutomaton::State> states;
+	bool any_alive = false;
 	for (size_t i = 0; i < itx.material->brdfs().size(); i++) {
 	    const BRDF* brdf = itx.material->brdfs()[i];
-	    results.push_back(new LightTree(brdf->surface_type(), brdf->emit(itx.point, itx.wo)));
+	    states.push_back(automaton.step(state, brdf->surface_type()));
+
+	    if (automaton.is_dead(states[i])) {
+		results.push_back(nullptr);
+	    } else {
+		results.push_back(new LightTree(brdf->surface_type(), brdf->emit(itx.point, itx.wo)));
+		any_alive = true;
+	    }
+	}
+
+	if (!any_alive) {
+	    return results;
 	}
 
 	// recursive call :
         if (max_bounces > 0) {
 	    for (size_t i = 0; i < results.size(); i++) {
+		if (!results[i]) {
+		    continue;
+		}
+		
 		const BRDF* brdf = itx.material->brdfs()[i];
 		
 		float pdf;
@@ -137,16 +488,38 @@ std::vector<LightTree*> trace_ray(const Scene& scene, Ray& ray, size_t max_bounc
 
 		Ray bounce_copy(bounce); // to avoid changing bounce.tmax
 		std::vector<LightTree*> bounce_trees =
-		    trace_ray(scene, bounce_copy, max_bounces - 1);
+		    trace_ray(scene, bounce_copy, automaton, states[i], max_bounces - 1);
 
 		for (LightTree* bounce_tree : bounce_trees) {
-		    results[i]->add_upstream(bounce_tree,
-					     f * cosine_factor / pdf);
+		    if (bounce_tree) {
+			results[i]->add_upstream(bounce_tree,
+						 f * cosine_factor / pdf);
+		    } else {
+			results[i]->add_pruned_upstream();
+		    }
 		}
 	    }
         }
 
-	// direct lighting
+	// direct lighting : the shadow rays are only needed for the branches
+	// that can still reach a light, and for the pruned branches of trees
+	// whose average over upstream branches depends on the light visibility
+	std::vector<bool> light_alive(results.size(), false);
+	bool shadow_rays_needed = false;
+	for (size_t i = 0; i < results.size(); i++) {
+	    if (!results[i]) {
+		continue;
+	    }
+	    light_alive[i] = !automaton.is_dead(automaton.step(states[i], SurfaceType::LIGHT));
+	    if (light_alive[i] || results[i]->has_traced_upstream()) {
+		shadow_rays_needed = true;
+	    }
+	}
+
+	if (!shadow_rays_needed) {
+	    return results;
+	}
+
 	Vec3 hover_point = itx.point + EPSILON * itx.normal;
 	for (const Light* light : scene.lights()) {
 	    if (light->is_shape(itx.shape)) {
@@ -160,6 +533,15 @@ std::vector<LightTree*> trace_ray(const Scene& scene, Ray& ray, size_t max_bounc
 	    
 	    if (!scene.ray_intersect(sample.shadow_ray)) {
 		for (size_t i = 0; i < results.size(); i++) {
+		    if (!results[i]) {
+			continue;
+		    }
+		    
+		    if (!light_alive[i]) {
+			results[i]->add_pruned_upstream();
+			continue;
+		    }
+		    
 		    const BRDF* brdf = itx.material->brdfs()[i];
 		
 		    RGBColor f = brdf->f(itx, wi, itx.wo);
@@ -226,83 +608,598 @@ std::string formatted_time(double seconds) {
     return ss.str();
 }
 
-void render(SyncData& sync, std::vector<RGBFilm>& output_images, const Options& options, const Scene& scene, const Camera& camera) {
-    size_t samples_taken = 0;
-    bool need_quit = false;
+// Traces a camera sample, bouncing at most max_bounces times. Returns the
+// radiance of each light path of the options, and that of every traced path in
+// all_radiances.
+std::vector<RGBColor> trace_sample(const Vec2& image_sample, size_t max_bounces,
+				   const LightPathAutomaton& automaton, LightPathAutomaton::State eye_state,
+				   const Options& options, const Scene& scene, const Camera& camera,
+				   std::vector<std::pair<PathSignature, RGBColor>>& all_radiances) {
+    Vec2 screen_sample = to_screen_space(image_sample, options.width, options.height);
+		
+    Ray camera_ray = camera.get_ray(screen_sample);
+
+    LightTree* eye_tree = new LightTree(SurfaceType::EYE, RGBColor());
+    for (LightTree* tree : trace_ray(scene, camera_ray, automaton, eye_state, max_bounces)) {
+	if (tree) {
+	    eye_tree->add_upstream(tree);
+	} else {
+	    eye_tree->add_pruned_upstream();
+	}
+    }
+
+    all_radiances = eye_tree->get_all_radiances();
+		
+    std::vector<RGBColor> radiances(options.light_paths.size());
+    for (const auto& p : all_radiances) {
+	for (size_t i : automaton.matches(automaton.run(p.first))) {
+	    if (i < radiances.size()) {
+		radiances[i] += p.second;
+	    }
+	}
+    }
+
+    delete eye_tree;
+
+    return radiances;
+}
+
+// Traces a camera sample, and splats the radiance of the light paths to the film
+void render_sample(const Vec2& image_sample, RGBFilmTile& film_tile, PathRadianceStore* path_store,
+		   const LightPathAutomaton& automaton, LightPathAutomaton::State eye_state,
+		   const Options& options, const Scene& scene, const Camera& camera) {
+    std::vector<std::pair<PathSignature, RGBColor>> all_radiances;
+    std::vector<RGBColor> radiances = trace_sample(image_sample, options.max_bounces, automaton, eye_state,
+						   options, scene, camera, all_radiances);
+		
+    film_tile.add_sample(image_sample, radiances);
+
+    if (path_store) {
+	path_store->add_sample(image_sample, all_radiances);
+    }
+}
+
+// State shared by the renderer and the preview window
+struct RenderControl {
+    // ends rendering for good : set by closing the window, or once a stop
+    // criterion is met
+    std::atomic<bool> stop;
+    // ends the current render, to start over from the moved camera
+    std::atomic<bool> restart;
+    // the camera isn't the one of the scene file anymore
+    std::atomic<bool> moved;
+
+    // guards camera, and the flags as they are waited for
+    std::mutex camera_mtx;
+    std::condition_variable changed;
+    Camera camera;
+
+    RenderControl(const Camera& camera)
+	: stop(false), restart(false), moved(false), camera(camera) {
+    }
+
+    bool interrupted() const {
+	return stop || restart;
+    }
+};
+
+// set by SIGINT and SIGTERM, to stop rendering and write the outputs
+static std::atomic<bool> termination_requested(false);
+
+extern "C" void request_termination(int) {
+    termination_requested = true;
+}
+
+std::string checkpoint_path(const Options& options) {
+    return "output/" + options.output_base + ".checkpoint";
+}
+
+std::vector<std::string> light_path_names(const Options& options) {
+    std::vector<std::string> names;
+    for (const LightPathExpression& light_path : options.light_paths) {
+	std::stringstream ss;
+	ss << light_path;
+	names.push_back(ss.str());
+    }
+    return names;
+}
+
+ToneMapper tone_mapper(const Options& options) {
+    return ToneMapper(options.exposure, options.tone_curve);
+}
+
+// Shows the image in the preview at 1/8, 1/4 then 1/2 of its resolution, with a
+// sample per block of pixels and direct lighting only, so that something
+// appears long before the first sample pass is done
+void render_coarse_preview(ThreadPool& pool, RenderControl& control, Preview& preview,
+			   const LightPathAutomaton& automaton, LightPathAutomaton::State eye_state,
+			   const Options& options, const Scene& scene, const Camera& camera) {
+    for (size_t scale = 8; scale > 1 && !control.interrupted(); scale /= 2) {
+	size_t rows = (options.height + scale - 1) / scale;
+	size_t columns = (options.width + scale - 1) / scale;
+	std::vector<Buffer2D<RGBColor>> layers(options.light_paths.size(), Buffer2D<RGBColor>(rows, columns));
+
+	pool.parallel_for(0, rows, [&](size_t row) {
+		if (control.interrupted()) {
+		    return;
+		}
+		
+		std::vector<std::pair<PathSignature, RGBColor>> all_radiances;
+		for (size_t col = 0; col < columns; col++) {
+		    seed_random_stream(row * columns + col);
+		    
+		    // center of the block, clipped to the image
+		    Vec2 image_sample(col * scale + 0.5f * std::min(scale, options.width - col * scale),
+				      row * scale + 0.5f * std::min(scale, options.height - row * scale));
+		    std::vector<RGBColor> radiances = trace_sample(image_sample, 0, automaton, eye_state,
+								   options, scene, camera, all_radiances);
+		    for (size_t i = 0; i < radiances.size(); i++) {
+			layers[i](row, col) = radiances[i];
+		    }
+		}
+	    });
+
+	if (!control.interrupted()) {
+	    preview.publish_upsampled(layers, scale);
+	}
+    }
+}
+
+// Average relative error of the pixels of a tile
+float tile_noise(const RGBFilm& film, const Tile& tile) {
+    float sum = 0.0f;
+    for (size_t row = tile.rowmin; row < tile.rowmax; row++) {
+	for (size_t col = tile.colmin; col < tile.colmax; col++) {
+	    sum += film.get_stats(row, col).relative_error();
+	}
+    }
+    return sum / ((tile.rowmax - tile.rowmin) * (tile.colmax - tile.colmin));
+}
+
+// Renders until the sample count or a stop criterion is reached, or until the
+// render is interrupted. Meeting a stop criterion sets control.stop.
+// Returns whether every pass of every tile was merged into the film.
+// Frames are published to the preview, if any, as tiles are merged, after
+// coarse frames if requested.
+// A resumed render skips the passes the checkpoint holds, and saves
+// checkpoints itself if enabled.
+bool render(ThreadPool& pool, RenderControl& control, RGBFilm& film, Preview* preview,
+	    PathRadianceStore* path_store, bool coarse_preview, const Checkpoint* resumed,
+	    const Options& options, const Scene& scene, const Camera& camera) {
+    LightPathAutomaton automaton(traced_light_paths(options));
+    LightPathAutomaton::State eye_state = automaton.step(automaton.start(), SurfaceType::EYE);
 
     double t0 = now();
     double last_time = t0;
 
-    while (samples_taken < options.sample_count && !need_quit) {
-#pragma omp parallel for schedule(static, 1)
-	for (size_t row = 0; row < options.height; row++) {
-	    for (size_t col = 0; col < options.width; col++) {
-		Vec2 image_sample = get_image_sample(row, col, options.width, options.height, samples_taken);
-		Vec2 screen_sample = to_screen_space(image_sample, options.width, options.height);
-		
-                Ray camera_ray = camera.get_ray(screen_sample);
+    // each tile is splatted to a private film tile, whose apron only overlaps
+    // the neighbouring tiles
+    size_t tile_size = render_tile_size(options);
+    std::vector<Tile> tiles = make_tiles(options.width, options.height, tile_size);
+    if (!options.regions.empty()) {
+	// the pixels around the regions are sampled too, for the filter to
+	// cover their borders as in a full render
+	std::vector<Tile> sampled_regions = options.regions;
+	size_t apron = film.apron();
+	for (Tile& region : sampled_regions) {
+	    region.rowmin = region.rowmin > apron ? region.rowmin - apron : 0;
+	    region.rowmax = std::min(region.rowmax + apron, options.height);
+	    region.colmin = region.colmin > apron ? region.colmin - apron : 0;
+	    region.colmax = std::min(region.colmax + apron, options.width);
+	}
+	tiles = clip_tiles(tiles, sampled_regions);
+    }
+    
+    // merging a film tile locks the tiles it overlaps, in increasing order
+    std::vector<std::vector<size_t>> neighbourhoods = tile_neighbourhoods(tiles, tile_size);
+    std::vector<std::mutex> tile_locks(tiles.size());
+
+    if (preview) {
+	preview->track_tiles(tiles);
+
+	if (coarse_preview) {
+	    render_coarse_preview(pool, control, *preview, automaton, eye_state, options, scene, camera);
+	}
+    }
+
+    size_t range_samples = options.sample_count - options.first_sample;
+    size_t pass_count = range_samples / options.tile_samples
+	+ (range_samples % options.tile_samples != 0);
+    size_t worker_count = pool.thread_count();
+    TileScheduler scheduler(tiles.size(), pass_count, worker_count);
+
+    // passes merged to each tile, under merge_mtx
+    std::vector<size_t> tile_passes(tiles.size(), 0);
+    if (resumed) {
+	if (resumed->tile_passes.size() != tiles.size()) {
+	    throw std::runtime_error("The checkpoint doesn't match the tiles of the render");
+	}
+	tile_passes = resumed->tile_passes;
+    }
+    std::vector<size_t> skipped_passes = tile_passes;
+    
+    size_t resumed_items = 0;
+    for (size_t passes : tile_passes) {
+	resumed_items += passes;
+    }
+    size_t resumed_samples = resumed_items / tiles.size() * options.tile_samples;
+    
+    std::atomic<bool> quit(false);
+    std::atomic<size_t> items_done(resumed_items);
+    std::mutex progress_mtx;
+
+    // checkpoints are taken once the workers are done with the items they took
+    bool checkpointing = options.checkpoint_interval > 0.0 && !control.moved;
+    double last_checkpoint = t0;
+    std::atomic<bool> checkpoint_due(false);
+
+    // tiles whose pixels are all under the adaptive threshold
+    std::vector<std::atomic<bool>> tile_converged(tiles.size());
+    for (std::atomic<bool>& converged : tile_converged) {
+	converged = false;
+    }
+    std::atomic<size_t> converged_count(0);
+
+    // noise of each tile, updated when it is merged
+    std::vector<std::atomic<float>> tile_noises(tiles.size());
+    for (std::atomic<float>& noise : tile_noises) {
+	noise = std::numeric_limits<float>::infinity();
+    }
+    
+    // Film tiles are merged in a fixed order, by pass then by tile index
+    // among overlapping tiles, so that the sums of a pixel don't depend on
+    // the timing of the workers : a finished film tile waits until the ones
+    // before it are merged. The workers are about one pass apart, which
+    // bounds the film tiles waiting.
+    std::mutex merge_mtx;
+    std::vector<std::map<size_t, RGBFilmTile>> pending_tiles(tiles.size());
+
+    // whether the next pass of the tile is finished and can be merged
+    auto mergeable = [&](size_t t) {
+	if (pending_tiles[t].empty() || pending_tiles[t].begin()->first != tile_passes[t]) {
+	    return false;
+	}
+	size_t pass = tile_passes[t];
+	for (size_t n : neighbourhoods[t]) {
+	    if (tile_passes[n] < pass + (n < t ? 1 : 0)) {
+		return false;
+	    }
+	}
+	return true;
+    };
+
+    // merging a tile lets its neighbours merge their next pass
+    auto merge_pending_tiles = [&](size_t t) {
+	std::unique_lock<std::mutex> merge_lock(merge_mtx);
+	std::vector<size_t> candidates(1, t);
+	while (!candidates.empty()) {
+	    size_t c = candidates.back();
+	    candidates.pop_back();
+	    if (!mergeable(c)) {
+		continue;
+	    }
+
+	    RGBFilmTile film_tile = std::move(pending_tiles[c].begin()->second);
+	    pending_tiles[c].erase(pending_tiles[c].begin());
+	    merge_lock.unlock();
 
-		LightTree* eye_tree = new LightTree(SurfaceType::EYE, RGBColor());
-		for (LightTree* tree : trace_ray(scene, camera_ray, options.max_bounces)) {
-		    eye_tree->add_upstream(tree);
+	    for (size_t n : neighbourhoods[c]) {
+		tile_locks[n].lock();
+	    }
+	    film.merge_tile(film_tile);
+	    if (options.target_noise > 0.0f) {
+		tile_noises[c] = tile_noise(film, tiles[c]);
+	    }
+	    for (size_t n : neighbourhoods[c]) {
+		tile_locks[n].unlock();
+	    }
+
+	    if (preview) {
+		for (size_t n : neighbourhoods[c]) {
+		    preview->invalidate(n);
 		}
+	    }
 
-		auto all_radiances = eye_tree->get_all_radiances();
+	    merge_lock.lock();
+	    tile_passes[c]++;
+	    candidates.insert(candidates.end(), neighbourhoods[c].begin(), neighbourhoods[c].end());
+	}
+    };
+    
+    // no barrier between passes : workers go through (tile, pass) items
+    // independently, and whichever completes a pass reports progress
+    auto work = [&](size_t worker) {
+	size_t t, pass;
+	while (!quit && !checkpoint_due && scheduler.next(worker, t, pass)) {
+	    // in the film already
+	    if (pass < skipped_passes[t]) {
+		continue;
+	    }
+	    
+	    const Tile& tile = tiles[t];
+	    RGBFilmTile film_tile = film.make_tile(tile.rowmin, tile.rowmax, tile.colmin, tile.colmax);
+
+	    size_t first_sample = options.first_sample + pass * options.tile_samples;
+	    size_t last_sample = std::min(first_sample + options.tile_samples, options.sample_count);
+
+	    // pixels of the tile left to sample
+	    size_t tile_width = tile.colmax - tile.colmin;
+	    std::vector<bool> active((tile.rowmax - tile.rowmin) * tile_width, true);
+	    
+	    if (tile_converged[t]) {
+		last_sample = first_sample;
+	    } else if (options.adaptive_threshold > 0.0f && pass * options.tile_samples >= options.adaptive_min_samples) {
+		bool any_active = false;
+		{
+		    std::lock_guard<std::mutex> lock(tile_locks[t]);
+		    for (size_t row = tile.rowmin; row < tile.rowmax; row++) {
+			for (size_t col = tile.colmin; col < tile.colmax; col++) {
+			    bool a = film.get_stats(row, col).relative_error() > options.adaptive_threshold;
+			    active[(row - tile.rowmin) * tile_width + col - tile.colmin] = a;
+			    any_active = any_active || a;
+			}
+		    }
+		}
+
+		if (!any_active && !tile_converged[t].exchange(true)) {
+		    if (++converged_count == tiles.size()) {
+			quit = true;
+		    }
+		}
+	    }
 		
-		for (size_t i = 0; i < options.light_paths.size(); i++) {
-		    RGBColor radiance;
-		    for (const auto& p : all_radiances) {
-			if (match(options.light_paths[i], p.first)) {
-			    radiance += p.second;
-			} 
+	    for (size_t sample = first_sample; sample < last_sample; sample++) {
+		for (size_t row = tile.rowmin; row < tile.rowmax; row++) {
+		    for (size_t col = tile.colmin; col < tile.colmax; col++) {
+			if (!active[(row - tile.rowmin) * tile_width + col - tile.colmin]) {
+			    continue;
+			}
+			
+			// renders don't depend on which thread traces which sample
+			seed_random_stream((sample * options.height + row) * options.width + col);
+			
+			Vec2 image_sample = get_image_sample(row, col, options.width, options.height, sample);
+			render_sample(image_sample, film_tile, path_store,
+				      automaton, eye_state, options, scene, camera);
 		    }
-		    output_images[i].add_sample(image_sample, radiance);
 		}
+	    }
 
-		delete eye_tree;
-            }
-        }
-	samples_taken++;
+	    {
+		std::lock_guard<std::mutex> lock(merge_mtx);
+		pending_tiles[t].emplace(pass, std::move(film_tile));
+	    }
+	    merge_pending_tiles(t);
 
-	double t1 = now();
-	double elapsed = t1 - t0;
-	double average = elapsed / samples_taken;
-	double expected_remaining = average * options.sample_count - elapsed;
+	    if (preview) {
+		preview->maybe_publish(film, tile_locks, now());
+	    }
+
+	    if (termination_requested) {
+		control.stop = true;
+	    }
+	    
+	    if (control.interrupted()) {
+		quit = true;
+	    }
+
+	    if (checkpointing && now() - last_checkpoint >= options.checkpoint_interval) {
+		checkpoint_due = true;
+	    }
+
+	    if (options.time_limit > 0.0 && now() - t0 >= options.time_limit) {
+		quit = true;
+		control.stop = true;
+	    }
+
+	    size_t done = ++items_done;
+	    if (done % tiles.size() != 0) {
+		continue;
+	    }
+	    
+	    {
+		std::lock_guard<std::mutex> lock(progress_mtx);
+		
+		size_t samples_taken = std::min(done / tiles.size() * options.tile_samples, range_samples);
+		
+		double t1 = now();
+		double elapsed = t1 - t0;
+		double average = elapsed / std::max<size_t>(samples_taken - resumed_samples, 1);
+
+		// the earliest of the stop criteria
+		double expected_remaining = std::numeric_limits<double>::infinity();
+		if (options.sample_count < std::numeric_limits<size_t>::max()) {
+		    expected_remaining = average * (range_samples - samples_taken);
+		}
+		if (options.time_limit > 0.0) {
+		    expected_remaining = std::min(expected_remaining, options.time_limit - elapsed);
+		}
+
+		float noise = 0.0f;
+		if (options.target_noise > 0.0f) {
+		    // over the pixels rendered, which crop windows clip
+		    std::vector<float> noises(tile_noises.begin(), tile_noises.end());
+		    noise = area_average(tiles, noises);
+		    
+		    if (noise <= options.target_noise) {
+			quit = true;
+			control.stop = true;
+		    }
+
+		    // the error decreases as the inverse square root of the sample count
+		    float ratio = noise / options.target_noise;
+		    double needed_samples = samples_taken * ratio * ratio;
+		    expected_remaining = std::min(expected_remaining, average * (needed_samples - samples_taken));
+		}
 	
-	std::cout << "sample " << samples_taken << " took "
-		  << t1 - last_time << "s ("
-		  << formatted_time(elapsed) << " elapsed, "
-		  << average << "s avg";
-	if (options.sample_count < std::numeric_limits<size_t>::max()) {
-	    std::cout << ", " << formatted_time(expected_remaining) << " remaining";
-	}
-	std::cout << ")\n";
-	last_time = t1;
+		std::cout << "sample " << samples_taken << " took "
+			  << t1 - last_time << "s ("
+			  << formatted_time(elapsed) << " elapsed, "
+			  << average << "s avg";
+		if (options.target_noise > 0.0f) {
+		    std::cout << ", noise " << noise;
+		}
+		if (std::isfinite(expected_remaining)) {
+		    std::cout << ", " << formatted_time(std::max(expected_remaining, 0.0)) << " remaining";
+		}
+		std::cout << ")\n";
+		last_time = t1;
+	    }
+	}
+    };
 
-	SDL_LockMutex(sync.mtx);
-	if (sync.quit) {
-	    need_quit = true;
+    while (true) {
+	pool.parallel_for(0, worker_count, work);
+
+	if (!checkpointing) {
+	    break;
 	}
-	SDL_UnlockMutex(sync.mtx);
+
+	// also when the render is over, to extend it later
+	Checkpoint checkpoint;
+	checkpoint.seed = options.seed;
+	checkpoint.tile_size = options.tile_size;
+	checkpoint.tile_samples = options.tile_samples;
+	checkpoint.first_sample = options.first_sample;
+	checkpoint.light_paths = light_path_names(options);
+	checkpoint.scene_file = options.scene_file;
+	checkpoint.max_bounces = options.max_bounces;
+	checkpoint.regions = options.regions;
+	checkpoint.filter_type = options.filter_type;
+	checkpoint.filter_radius = options.filter_radius;
+	checkpoint.tile_passes = tile_passes;
+	
+	save_checkpoint(checkpoint_path(options), checkpoint, film, path_store);
+	last_checkpoint = now();
+	
+	// the checkpoint just written holds a render that quit too
+	if (!checkpoint_due || quit) {
+	    break;
+	}
+	checkpoint_due = false;
+    }
+
+    // the last merged tiles may not have been published yet
+    if (preview) {
+	preview->publish(film, tile_locks, now());
     }
+
+    return std::count(tile_passes.begin(), tile_passes.end(), pass_count) == static_cast<long>(tiles.size());
 }
 
-struct RenderThreadData {
-    SyncData& sync;
-    std::vector<RGBFilm>& output_images;
-    const Options& options;
-    const Scene& scene;
-    const Camera& camera;
-};
+// Renders the image band by band, each a row of tiles rendered to completion,
+// and appends the rows finished by each band to binary PPM files of the
+// layers : the film only holds width x (tile size + 2 apron) pixels per layer.
+// An interrupted render completes the images with black rows
+void render_streaming(ThreadPool& pool, const Options& options, const Scene& scene, const Camera& camera) {
+    LightPathAutomaton automaton(traced_light_paths(options));
+    LightPathAutomaton::State eye_state = automaton.step(automaton.start(), SurfaceType::EYE);
 
-int render_thread(void* data) {
-    RenderThreadData* rtd = static_cast<RenderThreadData*>(data);
+    Filter filter(options.filter_type, options.filter_radius);
+    size_t apron = static_cast<size_t>(std::ceil(filter.radius()));
+    size_t tile_size = render_tile_size(options);
 
-    render(rtd->sync, rtd->output_images, rtd->options, rtd->scene, rtd->camera);
+    // the film tiles of a band overlap the rows of the bands next to it
+    RGBFilm film(options.width, options.height, 0, tile_size + 2 * apron,
+		 options.light_paths.size(), filter, options.compact_film);
 
-    return 0;
+    std::vector<std::ofstream> output_files;
+    for (const LightPathExpression& light_path : options.light_paths) {
+	std::stringstream path;
+	path << "output/" << options.output_base << "_" << light_path << ".ppm";
+	std::cout << "Writing " << path.str() << " ...\n";
+
+	output_files.emplace_back(path.str(), std::ios::binary);
+	output_files.back() << "P6\n" << options.width << " " << options.height << "\n255\n";
+    }
+
+    // rows written to the files so far
+    size_t rows_written = 0;
+    auto write_rows = [&](size_t end) {
+	for (size_t layer = 0; layer < output_files.size(); layer++) {
+	    Buffer2D<RGB8> image = film.get_image(layer, tone_mapper(options));
+	    write_raw(output_files[layer], &image(rows_written - film.first_row(), 0),
+		      (end - rows_written) * options.width);
+	}
+	rows_written = end;
+    };
+
+    double t0 = now();
+    double last_time = t0;
+    
+    size_t band_count = (options.height + tile_size - 1) / tile_size;
+    for (size_t band = 0; band < band_count && !termination_requested; band++) {
+	size_t rowmin = band * tile_size;
+	size_t rowmax = std::min(rowmin + tile_size, options.height);
+
+	// film tiles are merged in column order, as in render : a finished tile
+	// waits for the ones on its left
+	std::mutex merge_mtx;
+	std::map<size_t, RGBFilmTile> pending_tiles;
+	size_t merged_columns = 0;
+	pool.parallel_for(0, (options.width + tile_size - 1) / tile_size, [&](size_t column) {
+		size_t colmin = column * tile_size;
+		size_t colmax = std::min(colmin + tile_size, options.width);
+		RGBFilmTile film_tile = film.make_tile(rowmin, rowmax, colmin, colmax);
+
+		for (size_t sample = options.first_sample; sample < options.sample_count; sample++) {
+		    for (size_t row = rowmin; row < rowmax; row++) {
+			for (size_t col = colmin; col < colmax; col++) {
+			    // as in render
+			    seed_random_stream((sample * options.height + row) * options.width + col);
+
+			    Vec2 image_sample = get_image_sample(row, col, options.width, options.height, sample);
+			    render_sample(image_sample, film_tile, nullptr,
+					  automaton, eye_state, options, scene, camera);
+			}
+		    }
+		}
+
+		std::lock_guard<std::mutex> lock(merge_mtx);
+		pending_tiles.emplace(column, std::move(film_tile));
+		while (!pending_tiles.empty() && pending_tiles.begin()->first == merged_columns) {
+		    film.merge_tile(pending_tiles.begin()->second);
+		    pending_tiles.erase(pending_tiles.begin());
+		    merged_columns++;
+		}
+	    });
+
+	double t1 = now();
+	double average = (t1 - t0) / (band + 1);
+	std::cout << "band " << band + 1 << "/" << band_count << " took " << t1 - last_time << "s ("
+		  << formatted_time(t1 - t0) << " elapsed, "
+		  << formatted_time(average * (band_count - band - 1)) << " remaining)\n";
+	last_time = t1;
+
+	// the samples of the next bands don't reach the rows above
+	if (band + 1 < band_count) {
+	    write_rows(rowmax - apron);
+	    film.advance(rowmax - apron);
+	} else {
+	    write_rows(options.height);
+	}
+    }
+
+    if (rows_written < options.height) {
+	std::cout << "Interrupted, the images hold the first " << rows_written << " rows only\n";
+
+	// the headers announce the full height
+	std::vector<RGB8> black_row(options.width, RGB8{0, 0, 0});
+	for (std::ofstream& output_file : output_files) {
+	    for (size_t row = rows_written; row < options.height; row++) {
+		write_raw(output_file, black_row.data(), black_row.size());
+	    }
+	}
+    }
+
+    for (std::ofstream& output_file : output_files) {
+	if (!output_file) {
+	    throw std::runtime_error("Could not write the streamed images");
+	}
+    }
 }
 
+#ifdef WITH_SDL
 void update_title(SDL_Window* window, const Options& options, size_t current_img) {
     std::stringstream title;
     title << "renderer - " << options.light_paths[current_img];
@@ -310,7 +1207,25 @@ void update_title(SDL_Window* window, const Options& options, size_t current_img
     SDL_SetWindowTitle(window, title.str().c_str());
 }
 
-void display(SyncData& sync, const std::vector<RGBFilm>& output_images, const Options& options) {
+// Moves the camera of the renderer, which starts over
+void move_camera(RenderControl& control, const Vec3& offset, float yaw, float pitch) {
+    {
+	std::lock_guard<std::mutex> lock(control.camera_mtx);
+	control.camera.turn(yaw, pitch);
+	control.camera.move(offset);
+	control.restart = true;
+	control.moved = true;
+    }
+    control.changed.notify_all();
+}
+
+// Shows the frames published by the renderer ; the window only wakes up for
+// events, or when the next frame is due.
+// WASD, Q and E or the mouse wheel move the camera, dragging turns it.
+void display(RenderControl& control, Preview& preview, const Options& options) {
+    static const float turn_speed = 0.005f; // radians per pixel
+    
+
     SDL_Window* window =
 	SDL_CreateWindow("renderer",
 			 SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -318,81 +1233,492 @@ void display(SyncData& sync, const std::vector<RGBFilm>& output_images, const Op
 			 SDL_WINDOW_RESIZABLE);
     
     bool quit = false;
-    int current_img = 0;
-    SDL_Surface* surf = SDL_CreateRGBSurface(0, options.width, options.height, 32, 0, 0, 0, 0);
+    size_t layer_count = options.light_paths.size();
+    size_t current_img = 0;
+    // not a frame number yet, so that the first frame is drawn
+    size_t frame_number = std::numeric_limits<size_t>::max();
+    int frame_ms = static_cast<int>(1000.0f / options.preview_fps);
+    
+    // same layout as the preview frames, which are copied row by row
+    SDL_Surface* surf = SDL_CreateRGBSurfaceWithFormat(0, options.width, options.height, 32,
+							SDL_PIXELFORMAT_RGB888);
     
     update_title(window, options, current_img);
     
     while (!quit) {
-	SDL_Surface* winsurf = SDL_GetWindowSurface(window);
-	draw_image(output_images[current_img].get_image(), surf, 0, 0);
-	
-	blit_fit(surf, winsurf);
+	bool redraw = false;
 	
 	SDL_Event evt;
-	while (SDL_PollEvent(&evt)) {
-	    if (evt.type == SDL_QUIT) {
-		SDL_LockMutex(sync.mtx);
-		sync.quit = true;
-		SDL_UnlockMutex(sync.mtx);
+	if (SDL_WaitEventTimeout(&evt, frame_ms)) {
+	    do {
+		float step = options.camera_step;
+		
+		if (evt.type == SDL_QUIT) {
+		    {
+			std::lock_guard<std::mutex> lock(control.camera_mtx);
+			control.stop = true;
+		    }
+		    control.changed.notify_all();
 
-		quit = true;
-	    }
-	    if (evt.type == SDL_KEYDOWN)
-		switch (evt.key.keysym.sym) {
-		case SDLK_RIGHT:
-		    current_img = (current_img + 1) % output_images.size();
-		    update_title(window, options, current_img);
-		    break;
-		case SDLK_LEFT:
-		    current_img = (current_img + output_images.size() - 1) % output_images.size();
-		    update_title(window, options, current_img);
-		    break;
-	    }
+		    quit = true;
+		}
+		if (evt.type == SDL_MOUSEMOTION && (evt.motion.state & SDL_BUTTON_LMASK)) {
+		    move_camera(control, Vec3(0.0f, 0.0f, 0.0f),
+				-turn_speed * evt.motion.xrel, -turn_speed * evt.motion.yrel);
+		}
+		if (evt.type == SDL_MOUSEWHEEL) {
+		    move_camera(control, Vec3(0.0f, 0.0f, -step * evt.wheel.y), 0.0f, 0.0f);
+		}
+		if (evt.type == SDL_KEYDOWN)
+		    switch (evt.key.keysym.sym) {
+		    case SDLK_w:
+			move_camera(control, Vec3(0.0f, 0.0f, -step), 0.0f, 0.0f);
+			break;
+		    case SDLK_s:
+			move_camera(control, Vec3(0.0f, 0.0f, step), 0.0f, 0.0f);
+			break;
+		    case SDLK_a:
+			move_camera(control, Vec3(-step, 0.0f, 0.0f), 0.0f, 0.0f);
+			break;
+		    case SDLK_d:
+			move_camera(control, Vec3(step, 0.0f, 0.0f), 0.0f, 0.0f);
+			break;
+		    case SDLK_q:
+			move_camera(control, Vec3(0.0f, -step, 0.0f), 0.0f, 0.0f);
+			break;
+		    case SDLK_e:
+			move_camera(control, Vec3(0.0f, step, 0.0f), 0.0f, 0.0f);
+			break;
+		    case SDLK_RIGHT:
+			current_img = (current_img + 1) % layer_count;
+			update_title(window, options, current_img);
+			frame_number = std::numeric_limits<size_t>::max();
+			break;
+		    case SDLK_LEFT:
+			current_img = (current_img + layer_count - 1) % layer_count;
+			update_title(window, options, current_img);
+			frame_number = std::numeric_limits<size_t>::max();
+			break;
+		    }
+		
+		// the window may have been resized or exposed
+		redraw = true;
+	    } while (SDL_PollEvent(&evt));
 	}
 
-	SDL_UpdateWindowSurface(window);
+	if (preview.copy_front(current_img, frame_number, static_cast<uint32_t*>(surf->pixels), surf->pitch)) {
+	    redraw = true;
+	}
+
+	if (redraw) {
+	    blit_fit(surf, SDL_GetWindowSurface(window));
+	    SDL_UpdateWindowSurface(window);
+	}
+
+	// the renderer met its stop criteria
+	if (control.stop) {
+	    quit = true;
+	}
     }
     
     SDL_FreeSurface(surf);
     SDL_DestroyWindow(window);
 }
+#endif
+
+// Image cropped to the bounding box of the rendered regions, if any
+template<typename T>
+Buffer2D<T> cropped_to_regions(const Options& options, const Buffer2D<T>& image) {
+    if (options.regions.empty()) {
+	return image;
+    }
+    
+    Tile bounds = options.regions[0];
+    for (const Tile& region : options.regions) {
+	bounds.rowmin = std::min(bounds.rowmin, region.rowmin);
+	bounds.rowmax = std::max(bounds.rowmax, region.rowmax);
+	bounds.colmin = std::min(bounds.colmin, region.colmin);
+	bounds.colmax = std::max(bounds.colmax, region.colmax);
+    }
+
+    Buffer2D<T> cropped(bounds.rowmax - bounds.rowmin, bounds.colmax - bounds.colmin);
+    for (size_t row = 0; row < cropped.rows(); row++) {
+	for (size_t col = 0; col < cropped.columns(); col++) {
+	    cropped(row, col) = image(bounds.rowmin + row, bounds.colmin + col);
+	}
+    }
+    return cropped;
+}
+
+// Keeps the regions of an image, if only they were rendered : pasted into the
+// same image of a previous render when compositing, cropped to their bounding
+// box otherwise
+Buffer2D<RGB8> region_image(const Options& options, const Buffer2D<RGB8>& image, const std::string& suffix) {
+    if (options.regions.empty()) {
+	return image;
+    }
+
+    if (!options.composite_base.empty()) {
+	Buffer2D<RGB8> composite = read_png("output/" + options.composite_base + suffix + ".png");
+	if (composite.rows() != image.rows() || composite.columns() != image.columns()) {
+	    throw std::runtime_error("The composited render has a different image size");
+	}
+
+	for (const Tile& region : options.regions) {
+	    for (size_t row = region.rowmin; row < region.rowmax; row++) {
+		for (size_t col = region.colmin; col < region.colmax; col++) {
+		    composite(row, col) = image(row, col);
+		}
+	    }
+	}
+	return composite;
+    }
+
+    return cropped_to_regions(options, image);
+}
+
+// Writes the linear colors of the layers to an output/<base>_<light path>.pfm
+// file each, or to the single output/<base>.exr. Rendered regions are cropped
+// to, but not composited.
+void write_hdr_output(const Options& options, const std::vector<std::string>& light_paths,
+		      const std::vector<Buffer2D<RGBColor>>& layers, ThreadPool& pool) {
+    std::vector<Buffer2D<RGBColor>> cropped_layers;
+    for (const Buffer2D<RGBColor>& layer : layers) {
+	cropped_layers.push_back(cropped_to_regions(options, layer));
+    }
+
+    if (options.hdr_format == "exr") {
+	std::string path = "output/" + options.output_base + ".exr";
+	std::cout << "Writing " << path << " ...\n";
+
+	std::ofstream output_file(path, std::ios::binary);
+	write_exr(light_paths, cropped_layers, pool, output_file);
+    } else {
+	for (size_t i = 0; i < light_paths.size(); i++) {
+	    std::string path = "output/" + options.output_base + "_" + light_paths[i] + ".pfm";
+	    std::cout << "Writing " << path << " ...\n";
+
+	    std::ofstream output_file(path, std::ios::binary);
+	    write_pfm(cropped_layers[i], output_file);
+	}
+    }
+}
+
+// Safe to call for several images at once, from tasks of the pool
+void write_output(const Options& options, const LightPathExpression& light_path, const Buffer2D<RGB8>& image,
+		  ThreadPool& pool) {
+    std::stringstream suffix;
+    suffix << "_" << light_path;
+    std::string path = "output/" + options.output_base + suffix.str() + ".png";
+
+    // a single write, for the lines of concurrent calls not to mix
+    std::cout << "Writing " + path + " ...\n";
+
+    // before the file is opened, it may be the one composited into
+    Buffer2D<RGB8> output_image = region_image(options, image, suffix.str());
+    
+    std::ofstream output_file(path, std::ios::binary);
+	
+    write_png(output_image, pool, output_file);
+}
+
+// Throws std::runtime_error if a checkpoint can't continue the render asked for
+void check_resumable(const Checkpoint& checkpoint, const RGBFilm& film, const PathRadianceStore* path_store,
+		     const Options& options) {
+    if (film.width() != options.width || film.height() != options.height) {
+	throw std::runtime_error("The checkpoint has a different image size");
+    }
+
+    if (checkpoint.light_paths != light_path_names(options)) {
+	throw std::runtime_error("The checkpoint has different light paths");
+    }
+
+    if (checkpoint.scene_file != options.scene_file) {
+	throw std::runtime_error("The checkpoint is of the scene " + checkpoint.scene_file);
+    }
+
+    if (checkpoint.max_bounces != options.max_bounces) {
+	throw std::runtime_error("The checkpoint has a different bounce count");
+    }
+
+    bool same_regions = checkpoint.regions.size() == options.regions.size();
+    for (size_t i = 0; same_regions && i < options.regions.size(); i++) {
+	const Tile& a = checkpoint.regions[i];
+	const Tile& b = options.regions[i];
+	same_regions = a.rowmin == b.rowmin && a.rowmax == b.rowmax
+	    && a.colmin == b.colmin && a.colmax == b.colmax;
+    }
+    if (!same_regions) {
+	throw std::runtime_error("The checkpoint has different crop windows or tiles");
+    }
+
+    if (checkpoint.filter_type != options.filter_type || checkpoint.filter_radius != options.filter_radius) {
+	throw std::runtime_error("The checkpoint has a different filter");
+    }
+
+    size_t store_length = path_store ? path_store->max_length() : 0;
+    if (store_length != options.path_store_length) {
+	throw std::runtime_error("The checkpoint has a different path store length");
+    }
+
+    if (film.compact() != options.compact_film) {
+	throw std::runtime_error("The checkpoint film is compact and the render's isn't, or the reverse");
+    }
+}
+
+int query(const Options& options) {
+    std::ifstream input_file(options.query_file, std::ios::binary);
+    PathRadianceStore path_store(input_file);
+
+    std::vector<Buffer2D<RGBColor>> images = path_store.evaluate(options.light_paths);
+
+    ThreadPool pool(options.thread_count);
+    pool.parallel_for(0, options.light_paths.size(), [&](size_t i) {
+	    write_output(options, options.light_paths[i], to_rgb8(images[i], tone_mapper(options)), pool);
+	});
+
+    if (!options.hdr_format.empty()) {
+	write_hdr_output(options, light_path_names(options), images, pool);
+    }
+    
+    return 0;
+}
+
+std::vector<Buffer2D<RGBColor>> film_layers(const RGBFilm& film) {
+    std::vector<Buffer2D<RGBColor>> layers;
+    for (size_t i = 0; i < film.layer_count(); i++) {
+	layers.push_back(film.get_colors(i));
+    }
+    return layers;
+}
+
+void write_film(const Options& options, const PartialFilmInfo& info, const RGBFilm& film) {
+    std::string path = "output/" + options.output_base + ".film";
+    std::cout << "Writing " << path << " ...\n";
+
+    std::ofstream output_file(path, std::ios::binary);
+    write_partial_film(output_file, info, film);
+    if (!output_file) {
+	throw std::runtime_error("Could not write " + path);
+    }
+}
+
+RGBFilm read_film(const std::string& path, PartialFilmInfo& info) {
+    std::ifstream input_file(path, std::ios::binary);
+    if (!input_file) {
+	throw std::runtime_error("Could not open " + path);
+    }
+    return read_partial_film(input_file, info);
+}
+
+// Films of overlapping ranges would count the same samples twice, and films
+// of different seeds could hold correlated samples
+int merge(const Options& options) {
+    PartialFilmInfo info;
+    RGBFilm film = read_film(options.merge_files[0], info);
+
+    for (size_t i = 1; i < options.merge_files.size(); i++) {
+	const std::string& path = options.merge_files[i];
+	PartialFilmInfo other_info;
+	RGBFilm other = read_film(path, other_info);
+	if (other_info.light_paths != info.light_paths) {
+	    throw std::runtime_error(path + " has different light paths");
+	}
+	if (other_info.seed != info.seed) {
+	    throw std::runtime_error(path + " was rendered with a different seed");
+	}
+	for (const std::pair<size_t, size_t>& range : info.sample_ranges) {
+	    for (const std::pair<size_t, size_t>& other_range : other_info.sample_ranges) {
+		if (range.first < other_range.second && other_range.first < range.second) {
+		    throw std::runtime_error(path + " has samples " + std::to_string(other_range.first) + ":"
+					     + std::to_string(other_range.second) + ", overlapping "
+					     + std::to_string(range.first) + ":" + std::to_string(range.second));
+		}
+	    }
+	}
+	
+	film.merge(other);
+	info.sample_ranges.insert(info.sample_ranges.end(),
+				  other_info.sample_ranges.begin(), other_info.sample_ranges.end());
+    }
+    const std::vector<std::string>& light_paths = info.light_paths;
+
+    ThreadPool pool(options.thread_count);
+    pool.parallel_for(0, light_paths.size(), [&](size_t i) {
+	    write_output(options, LightPathExpression(light_paths[i]), film.get_image(i, tone_mapper(options)), pool);
+	});
+    if (!options.hdr_format.empty()) {
+	write_hdr_output(options, light_paths, film_layers(film), pool);
+    }
+    write_film(options, info, film);
+
+    return 0;
+}
+
+int stream(const Options& options) {
+    std::signal(SIGINT, request_termination);
+    std::signal(SIGTERM, request_termination);
+
+    TOMLParser parser(options.scene_file, static_cast<float>(options.width) / options.height);
+
+    initialize_random_system(options.seed);
+
+    ThreadPool pool(options.thread_count);
+    std::cout << "Rendering with " << pool.thread_count() << " threads\n";
+
+    render_streaming(pool, options, parser.scene(), parser.camera());
+
+    return 0;
+}
 
 int main(int argc, char** argv) {
     Options options = parse_options(argc, argv);
-    std::vector<RGBFilm> output_images;
-    for (size_t i = 0; i < options.light_paths.size(); i++) {
-	output_images.push_back(RGBFilm(options.width, options.height, options.filter_radius));
+    if (!options.query_file.empty()) {
+	return query(options);
+    }
+    if (options.merge) {
+	return merge(options);
+    }
+    if (options.streaming) {
+	return stream(options);
+    }
+    
+    Filter filter(options.filter_type, options.filter_radius);
+    RGBFilm film(options.width, options.height, options.light_paths.size(), filter, options.compact_film);
+
+    PathRadianceStore* path_store = nullptr;
+    Checkpoint checkpoint;
+    if (!options.resume_file.empty()) {
+	std::ifstream input_file(options.resume_file, std::ios::binary);
+	if (!input_file) {
+	    throw std::runtime_error("Could not open " + options.resume_file);
+	}
+	checkpoint = read_checkpoint(input_file, film, path_store);
+	check_resumable(checkpoint, film, path_store, options);
+
+	// the remaining items must be split and seeded as in the first run
+	options.seed = checkpoint.seed;
+	options.tile_size = checkpoint.tile_size;
+	options.tile_samples = checkpoint.tile_samples;
+	options.first_sample = checkpoint.first_sample;
+	if (options.sample_count <= options.first_sample) {
+	    throw std::runtime_error("The checkpoint starts past the last sample");
+	}
+	std::cout << "Resuming from " << options.resume_file << "\n";
+    } else if (options.path_store_length > 0) {
+	path_store = new PathRadianceStore(options.width, options.height,
+					   options.path_store_length, filter);
     }
+    const Checkpoint* resumed = options.resume_file.empty() ? nullptr : &checkpoint;
 
     TOMLParser parser(options.scene_file, static_cast<float>(options.width) / options.height);
     
-    SDL_Init(SDL_INIT_VIDEO);
     initialize_random_system(options.seed);
 
-    SyncData sync{ false, SDL_CreateMutex() };
-    
-    RenderThreadData data{sync, output_images, options, parser.scene(), parser.camera()};
-    SDL_Thread* thread = SDL_CreateThread(render_thread, "render", &data);
+    RenderControl control(parser.camera());
 
-    display(sync, output_images, options);
+    ThreadPool pool(options.thread_count);
+    std::cout << "Rendering with " << pool.thread_count() << " threads\n";
 
-    SDL_WaitThread(thread, nullptr);
+    // whether the render took all of its samples, as needed for sample ranges
+    bool complete = false;
+    if (options.headless) {
+	// stops the render, which is still written out ; with a preview, SDL
+	// turns these signals into closing the window instead
+	std::signal(SIGINT, request_termination);
+	std::signal(SIGTERM, request_termination);
 
-    for (size_t i = 0; i < options.light_paths.size(); i++) {
-	std::stringstream oss;
-	oss << "output/" << options.output_base << "_" << options.light_paths[i] << ".png";
+	// the main thread helps the workers until the render is done
+	complete = render(pool, control, film, nullptr, path_store, false, resumed,
+			  options, parser.scene(), control.camera);
+    } else {
+#ifdef WITH_SDL
+	SDL_Init(SDL_INIT_VIDEO);
 
-	std::cout << "Writing " << oss.str() << " ...\n";
+	Preview preview(options.width, options.height, options.light_paths.size(),
+			1.0 / options.preview_fps, tone_mapper(options));
 	
-	std::ofstream output_file(oss.str());
+	// the display loop keeps the main thread, rendering runs in the pool
+	ThreadPool::TaskGroup render_task;
+	pool.submit(render_task, [&]() {
+		bool coarse_preview = options.progressive_preview;
+		
+		std::unique_lock<std::mutex> lock(control.camera_mtx);
+		while (!control.stop) {
+		    Camera camera = control.camera;
+		    control.restart = false;
+		    lock.unlock();
+		    
+		    render(pool, control, film, &preview, path_store, coarse_preview, resumed,
+			   options, parser.scene(), camera);
+		    resumed = nullptr;
+
+		    // the render is over or interrupted : waits for the camera
+		    // to move, or for the window to close
+		    lock.lock();
+		    control.changed.wait(lock, [&]() { return control.interrupted(); });
+
+		    // the scene is kept, the samples are not
+		    if (!control.stop) {
+			film.clear();
+			if (path_store) {
+			    path_store->clear();
+			}
+			coarse_preview = true;
+		    }
+		}
+	    });
+
+	display(control, preview, options);
+
+	pool.wait(render_task);
+#endif
+    }
+
+    // tone-mapped straight from the film, the layers encoded concurrently
+    pool.parallel_for(0, options.light_paths.size(), [&](size_t i) {
+	    write_output(options, options.light_paths[i], film.get_image(i, tone_mapper(options)), pool);
+	});
+
+    if (!options.hdr_format.empty()) {
+	write_hdr_output(options, light_path_names(options), film_layers(film), pool);
+    }
+
+    if (options.write_film && !complete) {
+	// merging it would leave the missing samples out of the image
+	std::cerr << "The render stopped before the end of its sample range, no film is written\n";
+	return 1;
+    }
+    if (options.write_film) {
+	PartialFilmInfo info;
+	info.seed = options.seed;
+	info.sample_ranges.push_back(std::make_pair(options.first_sample, options.sample_count));
+	info.light_paths = light_path_names(options);
+	write_film(options, info, film);
+    }
+
+    if (options.adaptive_threshold > 0.0f) {
+	std::string path = "output/" + options.output_base + "_samples.png";
+	std::cout << "Writing " << path << " ...\n";
+
+	std::ofstream output_file(path, std::ios::binary);
+	write_png(region_image(options, film.get_sample_count_image(), "_samples"), pool, output_file);
+    }
+
+    if (path_store) {
+	std::string path = "output/" + options.output_base + ".lpstore";
+	std::cout << "Writing " << path << " (" << path_store->entry_count() << " entries) ...\n";
 	
-	Buffer2D<RGBColor> colors = output_images[i].get_colors();
-	write_png(to_rgb8(colors), output_file);
+	std::ofstream output_file(path, std::ios::binary);
+	path_store->write(output_file);
+	
+	delete path_store;
     }
 
-    SDL_DestroyMutex(sync.mtx);
-    SDL_Quit();
+#ifdef WITH_SDL
+    if (!options.headless) {
+	SDL_Quit();
+    }
+#endif
     return 0;
 }
-
@@ -5,6 +5,9 @@
 
 #include <ANN/ANN.h>
 
+#include <atomic>
+#include <thread>
+
 static const size_t coarse_radius = 1;
 static const size_t fine_radius = 2;
 
@@ -176,7 +179,9 @@ best_approximate_match(const ImageAnalogySystem& system, size_t level, Vec2s q,
 	system.target.unfiltered[level], q, fine_radius
 	);
     ANNidx result_idx;
-    
+
+    // libANN keeps its search state in thread_local variables, so that
+    // queries can run concurrently.
     // libANN does not use const qualifiers, have to cast away constness here :
     const_cast<ANNkd_tree&>(system.kd_trees[level])
 	.annkSearch(
@@ -263,18 +268,47 @@ Vec2s brute_force_best_match(const ImageAnalogySystem& system, size_t level, Vec
     return result;
 }
 
-void solve(ImageAnalogySystem& system) {
+void solve(ImageAnalogySystem& system, ThreadPool& pool) {
     std::cout << "Solving\n";
     for (size_t l = system.levels - 1; l < system.levels; l--) {
 	std::cout << "level " << l << "\n";
-	Vec2s q;
-	for(q[0] = 2; q[0] + 2 < system.target.filtered[l].rows(); q[0]++) {
-	    for(q[1] = 2; q[1] + 2 < system.target.filtered[l].columns(); q[1]++) {
-		Vec2s p = best_match(system, l, q);
-		system.target.filtered[l](q) = system.source.filtered[l](p);
-		system.assignments[l](q) = p;
-	    }
+
+	size_t rows = system.target.filtered[l].rows();
+	size_t columns = system.target.filtered[l].columns();
+	if (rows < 5 || columns < 5) {
+	    continue;
 	}
+
+	// Matching a pixel reads the results of the previous rows up to two
+	// columns ahead, and must not see those of the next rows. Rows are
+	// solved as a wavefront : a row can match column c once the previous
+	// row is done with column c + 2, which gives the scanline order result.
+	
+	// first column left to match in each row
+	std::vector<std::atomic<size_t>> progress(rows);
+	for (std::atomic<size_t>& p : progress) {
+	    p = 2;
+	}
+	std::atomic<size_t> next_row(2);
+	
+	pool.parallel_for(0, pool.thread_count(), [&](size_t) {
+	    for (size_t row = next_row++; row + 2 < rows; row = next_row++) {
+		Vec2s q;
+		q[0] = row;
+		for (q[1] = 2; q[1] + 2 < columns; q[1]++) {
+		    size_t needed = std::min(q[1] + 3, columns - 2);
+		    while (row > 2 && progress[row - 1] < needed) {
+			std::this_thread::yield();
+		    }
+		    
+		    Vec2s p = best_match(system, l, q);
+		    system.target.filtered[l](q) = system.source.filtered[l](p);
+		    system.assignments[l](q) = p;
+
+		    progress[row] = q[1] + 1;
+		}
+	    }
+	});
     }
 }
 
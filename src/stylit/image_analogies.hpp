@@ -3,6 +3,7 @@
 #include "../Color.hpp"
 #include "../Image.hpp"
 #include "../Vec.hpp"
+#include "../ThreadPool.hpp"
 
 #include "EigenArray2D.hpp"
 
@@ -41,7 +42,7 @@ struct ImageAnalogySystem {
 
 FeatureImage multichannel_image(const std::vector<Buffer2D<RGBColor>>& images);
 
-void solve(ImageAnalogySystem& system);
+void solve(ImageAnalogySystem& system, ThreadPool& pool);
 
 Feature rgb_to_feature(const RGBColor& color);
 RGBColor feature_to_rgb(const Feature& feature);
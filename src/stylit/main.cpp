@@ -1,14 +1,12 @@
+#ifdef WITH_SDL
 #include "../display.hpp"
+#endif
 #include "../util.hpp"
 #include "image_analogies.hpp"
 
 #include <fstream>
 
-struct StylitThreadData {
-    SyncData& sync;
-    ImageAnalogySystem& system;
-};
-
+#ifdef WITH_SDL
 static void display(SyncData& sync, const ImageAnalogySystem& system) {
     SDL_Window* window =
 	SDL_CreateWindow("renderer",
@@ -22,8 +20,8 @@ static void display(SyncData& sync, const ImageAnalogySystem& system) {
     while (!quit) {
 	size_t w = std::max(system.source.unfiltered[lvl].columns(), system.target.unfiltered[lvl].columns());
 	size_t h = std::max(system.source.unfiltered[lvl].rows(), system.target.unfiltered[lvl].rows());
-	SDL_Surface* surf = SDL_CreateRGBSurface(0,
-						 2 * w, 2 * h, 32, 0, 0, 0, 0);
+	// in the format draw_image writes directly
+	SDL_Surface* surf = SDL_CreateRGBSurfaceWithFormat(0, 2 * w, 2 * h, 32, SDL_PIXELFORMAT_RGB888);
 	
 	SDL_Rect rect{0, 0, 2 * w, 2 * h};
 	SDL_FillRect(surf, &rect, 0);
@@ -62,14 +60,7 @@ static void display(SyncData& sync, const ImageAnalogySystem& system) {
     
     SDL_DestroyWindow(window);
 }
-
-int stylit_thread(void* data) {
-    StylitThreadData* thread_data = static_cast<StylitThreadData*>(data);
-    
-    solve(thread_data->system);
-    
-    return 0;
-}
+#endif
 
 struct StylitArgs {
     FeatureImage images[3];
@@ -78,19 +69,31 @@ struct StylitArgs {
     float kappa;
     float epsilon;
     bool gui;
+    // 0 uses one thread per hardware thread
+    size_t thread_count;
 };
 
 void print_usage() {
     std::cerr << "Usage :";
 }
 
+// PFM images hold linear colors, the others 8-bit sRGB ones
+bool is_pfm(const std::string& path) {
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0;
+}
+
 StylitArgs parse_args(int argc, char** argv) {
     StylitArgs args;
 
     args.levels = 6;
     args.kappa = 0.0f;
     args.epsilon = 0.0f;
+#ifdef WITH_SDL
     args.gui = true;
+#else
+    args.gui = false;
+#endif
+    args.thread_count = 0;
 
     int img_index = 0;
     int i = 1;
@@ -107,6 +110,9 @@ StylitArgs parse_args(int argc, char** argv) {
 	} else if (arg == "--epsilon") {
 	    args.epsilon = parse<float>(argv[i+1]);
 	    i++;
+	} else if (arg == "--threads") {
+	    args.thread_count = parse<size_t>(argv[i+1]);
+	    i++;
 	} else if (arg == "--no-gui") {
 	    args.gui = false;
 	} else if (arg == ",") {
@@ -121,7 +127,7 @@ StylitArgs parse_args(int argc, char** argv) {
 	    }
 	} else {
 	    if (img_index < 3) {
-		read_images.push_back(to_rgbcolor(read_png(arg)));
+		read_images.push_back(is_pfm(arg) ? read_pfm(arg) : to_rgbcolor(read_png(arg)));
 	    } else {
 		args.output_file = arg;
 	    }
@@ -134,9 +140,6 @@ StylitArgs parse_args(int argc, char** argv) {
 }
 
 int main(int argc, char** argv) {
-    SDL_Init(SDL_INIT_VIDEO);
-    SyncData sync{ false, SDL_CreateMutex() };
-
     StylitArgs args = parse_args(argc, argv);
         
     ImageAnalogySystem system(args.images[0],
@@ -146,18 +149,32 @@ int main(int argc, char** argv) {
 			      args.kappa,
 			      args.epsilon);
 
-    StylitThreadData thread_data{sync, system};
+    ThreadPool pool(args.thread_count);
 
     if (args.gui) {
-	SDL_Thread* thread = SDL_CreateThread(stylit_thread, "stylit", &thread_data);
+#ifdef WITH_SDL
+	SDL_Init(SDL_INIT_VIDEO);
+	SyncData sync{ false, SDL_CreateMutex() };
+	
+	// the display loop keeps the main thread, solving runs in the pool
+	ThreadPool::TaskGroup solve_task;
+	pool.submit(solve_task, [&]() { solve(system, pool); });
 	display(sync, system);
-	SDL_WaitThread(thread, nullptr);
+	pool.wait(solve_task);
+
+	SDL_DestroyMutex(sync.mtx);
+	SDL_Quit();
+#endif
     } else {
-	stylit_thread(&thread_data);
+	solve(system, pool);
     }
 
-    std::ofstream output_file(args.output_file);
-    write_png(to_rgb8(feature_to_rgb(system.target.filtered[0])), output_file);
+    std::ofstream output_file(args.output_file, std::ios::binary);
+    if (is_pfm(args.output_file)) {
+	write_pfm(feature_to_rgb(system.target.filtered[0]), output_file);
+    } else {
+	write_png(to_rgb8(feature_to_rgb(system.target.filtered[0])), pool, output_file);
+    }
     
     return 0;
 }
@@ -3,6 +3,8 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <iostream>
+#include <stdexcept>
 
 static inline std::string timestamp()
 {
@@ -23,4 +25,35 @@ T parse(const std::string& s) {
     return v;
 }
 
+// Binary file helpers : values are written as laid out in memory
+
+template<typename T>
+void write_raw(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+T read_raw(std::istream& in) {
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if (!in) {
+	throw std::runtime_error("Unexpected end of file");
+    }
+    return value;
+}
+
+// count contiguous values at once
+template<typename T>
+void write_raw(std::ostream& out, const T* values, size_t count) {
+    out.write(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+template<typename T>
+void read_raw(std::istream& in, T* values, size_t count) {
+    in.read(reinterpret_cast<char*>(values), count * sizeof(T));
+    if (!in) {
+	throw std::runtime_error("Unexpected end of file");
+    }
+}
+
 
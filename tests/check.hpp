@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+// Minimal self-checking tests : each test executable runs its checks, reports
+// the failed ones and exits with the number of failures
+
+static int check_failures = 0;
+
+#define CHECK(condition)						\
+    do {								\
+	if (!(condition)) {						\
+	    std::cerr << __FILE__ << ":" << __LINE__ << ": " << #condition << " failed\n"; \
+	    check_failures++;						\
+	}								\
+    } while (false)
+
+#define CHECK_NEAR(a, b, tolerance)					\
+    do {								\
+	double check_a = (a);						\
+	double check_b = (b);						\
+	if (!(std::abs(check_a - check_b) <= (tolerance))) {		\
+	    std::cerr << __FILE__ << ":" << __LINE__ << ": " << #a << " = " << check_a \
+		      << ", " << #b << " = " << check_b << "\n";	\
+	    check_failures++;						\
+	}								\
+    } while (false)
+
+inline int check_result() {
+    if (check_failures > 0) {
+	std::cerr << check_failures << " checks failed\n";
+    }
+    return check_failures > 0 ? 1 : 0;
+}
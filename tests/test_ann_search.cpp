@@ -0,0 +1,61 @@
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <ANN/ANN.h>
+
+#include "check.hpp"
+
+// Queries run concurrently on a shared kd-tree find the same neighbours as
+// queries run one at a time, as stylit's workers rely on
+int main() {
+    const int dim = 8;
+    const int point_count = 5000;
+    const int query_count = 4000;
+    const int thread_count = 8;
+    const double epsilon = 0.5;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coordinate(0.0f, 1.0f);
+
+    ANNpointArray points = annAllocPts(point_count, dim);
+    for (int i = 0; i < point_count; i++) {
+	for (int d = 0; d < dim; d++) {
+	    points[i][d] = coordinate(rng);
+	}
+    }
+    std::vector<float> queries(query_count * dim);
+    for (float& q : queries) {
+	q = coordinate(rng);
+    }
+
+    ANNkd_tree tree(points, point_count, dim);
+
+    std::vector<ANNidx> expected(query_count);
+    for (int i = 0; i < query_count; i++) {
+	ANNdist dist2;
+	tree.annkSearch(&queries[i * dim], 1, &expected[i], &dist2, epsilon);
+    }
+
+    std::vector<ANNidx> found(query_count);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++) {
+	threads.push_back(std::thread([&, t]() {
+	    for (int i = t; i < query_count; i += thread_count) {
+		ANNdist dist2;
+		tree.annkSearch(&queries[i * dim], 1, &found[i], &dist2, epsilon);
+	    }
+	}));
+    }
+    for (std::thread& thread : threads) {
+	thread.join();
+    }
+
+    for (int i = 0; i < query_count; i++) {
+	CHECK(found[i] == expected[i]);
+    }
+
+    annDeallocPts(points);
+    annClose();
+    return check_result();
+}
@@ -0,0 +1,212 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "Color.hpp"
+#include "check.hpp"
+
+static float half_value(uint16_t bits) {
+    RGBHalf h;
+    h.r = bits;
+    return h.to_float()[0];
+}
+
+static uint16_t half_bits(float value) {
+    return RGBHalf(RGBColor(value, 0, 0)).r;
+}
+
+// every finite half converts to a float and back to itself
+static void test_half_round_trip() {
+    for (uint32_t bits = 0; bits < 0x10000; bits++) {
+	if (((bits >> 10) & 0x1f) == 0x1f) {
+	    continue;
+	}
+	uint16_t h = static_cast<uint16_t>(bits);
+	CHECK(half_bits(half_value(h)) == h);
+    }
+}
+
+static void test_half_rounding() {
+    // 1 + 2^-11 lies halfway between 1 and the next half, rounds to the even one
+    CHECK(half_bits(1.0f + 1.0f / 2048) == 0x3c00);
+    CHECK(half_bits(1.0f + 3.0f / 2048) == 0x3c02);
+    CHECK(half_bits(1.0f + 1.5f / 2048) == 0x3c01);
+    // smallest subnormal, and half of it rounding to 0
+    CHECK(half_bits(1.0f / 16777216) == 0x0001);
+    CHECK(half_bits(0.5f / 16777216) == 0x0000);
+    // saturates at 65504 instead of overflowing
+    CHECK(half_bits(65504.0f) == 0x7bff);
+    CHECK(half_bits(1e9f) == 0x7bff);
+    CHECK(half_bits(-1e9f) == 0xfbff);
+
+    // relative error of normal halves is at most 2^-11
+    for (float x = 6.2e-5f; x < 60000.0f; x *= 1.0137f) {
+	CHECK_NEAR(half_value(half_bits(x)) / x, 1.0, 1.0 / 2048);
+    }
+}
+
+// stochastic rounding keeps exact halves, and averages to the value rounded
+static void test_half_stochastic_rounding() {
+    uint64_t random = 1;
+    auto next_random = [&random]() {
+	random = random * 6364136223846793005ull + 1442695040888963407ull;
+	return random;
+    };
+
+    for (uint16_t h : {0x0000, 0x0001, 0x3555, 0x3c00, 0x7bff}) {
+	for (int i = 0; i < 100; i++) {
+	    CHECK(RGBHalf::round_stochastic(RGBColor(half_value(h), 0, 0), next_random()).r == h);
+	}
+    }
+
+    for (float x : {3e-6f, 0.1f, 0.65f, 1.0f + 1.0f / 4096, 777.7f, 65510.0f}) {
+	const int count = 100000;
+	double sum = 0.0;
+	for (int i = 0; i < count; i++) {
+	    RGBHalf h = RGBHalf::round_stochastic(RGBColor(x, x, x), next_random());
+	    CHECK(h.r == half_bits(x) || h.r == half_bits(x) + 1 || h.r == half_bits(x) - 1);
+	    sum += h.to_float()[0] + h.to_float()[1] + h.to_float()[2];
+	}
+	// within a few standard errors, of at most half an ulp each
+	double ulp = half_value(half_bits(x) + 1) - half_value(half_bits(x));
+	double expected = x < 65504.0f ? x : 65504.0f;
+	CHECK_NEAR(sum / (3 * count), expected, 4.0 * 0.5 * ulp / std::sqrt(3.0 * count));
+    }
+}
+
+static float bits_float(uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// the encoding the lookup tables replace : clamped, sRGB curve, truncated
+static uint8_t reference_code(float lin) {
+    lin = lin < 0.0f ? 0.0f : lin;
+    float srgb = lin <= .0031308 ? lin * 12.92 : lin >= 1.0f ? 1.0f : (1 + .055f) * std::pow(lin, 1.0f / 2.4f) - .055f;
+    return static_cast<uint8_t>(srgb * 255.0f);
+}
+
+// codes of single colors, which take the scalar path, and of batches, which
+// take the SSE2 one
+static std::vector<uint8_t> single_codes(const ToneMapper& tone, const std::vector<float>& values) {
+    std::vector<uint8_t> codes;
+    for (float value : values) {
+	codes.push_back(tone(RGBColor(value, value, value)).g);
+    }
+    return codes;
+}
+
+static std::vector<uint8_t> batch_codes(const ToneMapper& tone, const std::vector<float>& values) {
+    std::vector<RGBColor> colors;
+    for (float value : values) {
+	colors.push_back(RGBColor(value, value, value));
+    }
+    std::vector<RGB8> rgb8(colors.size());
+    tone.map(colors.data(), colors.size(), rgb8.data());
+    std::vector<uint8_t> codes;
+    for (const RGB8& c : rgb8) {
+	codes.push_back(c.g);
+    }
+    return codes;
+}
+
+// the tables give the codes of the sRGB curve for every float, the
+// neighbours of each step included
+static void test_tone_tables() {
+    std::vector<float> values;
+    for (uint32_t bits = 0; bits <= 0x3fc00000; bits += 997) {
+	values.push_back(bits_float(bits));
+    }
+    for (int code = 1; code < 256; code++) {
+	// smallest float of the code
+	uint32_t low = 0;
+	uint32_t high = 0x3f800000;
+	while (low < high) {
+	    uint32_t middle = low + (high - low) / 2;
+	    if (reference_code(bits_float(middle)) >= code) {
+		high = middle;
+	    } else {
+		low = middle + 1;
+	    }
+	}
+	values.push_back(bits_float(low));
+	values.push_back(bits_float(low - 1));
+    }
+
+    ToneMapper tone;
+    std::vector<uint8_t> single = single_codes(tone, values);
+    std::vector<uint8_t> batch = batch_codes(tone, values);
+    for (size_t i = 0; i < values.size(); i++) {
+	CHECK(single[i] == reference_code(values[i]));
+	CHECK(batch[i] == single[i]);
+    }
+}
+
+static void test_tone_special_values() {
+    std::vector<float> values = {-1.0f, -0.0f, 1e-30f, 1e30f, std::numeric_limits<float>::infinity()};
+    std::vector<uint8_t> expected = {0, 0, 0, 255, 255};
+    for (ToneMapper::Curve curve : {ToneMapper::CLAMP, ToneMapper::FILMIC}) {
+	ToneMapper tone(0.0f, curve);
+	CHECK(single_codes(tone, values) == expected);
+	CHECK(batch_codes(tone, values) == expected);
+    }
+}
+
+static void test_tone_exposure_and_curve() {
+    std::vector<float> values;
+    for (float x = 1e-4f; x < 100.0f; x *= 1.01f) {
+	values.push_back(x);
+    }
+    std::vector<float> doubled;
+    for (float x : values) {
+	doubled.push_back(2.0f * x);
+    }
+    CHECK(batch_codes(ToneMapper(1.0f), values) == batch_codes(ToneMapper(), doubled));
+
+    // the filmic curve keeps the order of the values, and compresses the
+    // highlights instead of clipping them
+    ToneMapper filmic(0.0f, ToneMapper::FILMIC);
+    std::vector<uint8_t> single = single_codes(filmic, values);
+    std::vector<uint8_t> batch = batch_codes(filmic, values);
+    CHECK(single == batch);
+    for (size_t i = 1; i < batch.size(); i++) {
+	CHECK(batch[i] >= batch[i - 1]);
+    }
+    CHECK(filmic(RGBColor(2.0f, 2.0f, 2.0f)).g < 255);
+}
+
+// decoding gives back the linear values of the codes, in increasing order
+static void test_srgb_decoding() {
+    std::vector<RGB8> codes;
+    for (int code = 0; code < 256; code++) {
+	codes.push_back(RGB8{static_cast<uint8_t>(code), static_cast<uint8_t>(code), static_cast<uint8_t>(code)});
+    }
+    std::vector<RGBColor> colors(codes.size());
+    srgb_to_linear(codes.data(), codes.size(), colors.data());
+
+    CHECK(colors[0][0] == 0.0f);
+    CHECK(colors[255][0] == 1.0f);
+    for (int code = 0; code < 256; code++) {
+	CHECK(srgb_to_linear(codes[code])[1] == colors[code][1]);
+	float srgb = code / 255.0f;
+	double expected = srgb <= .04045 ? srgb / 12.92 : std::pow((srgb + .055) / 1.055, 2.4);
+	CHECK_NEAR(colors[code][2], expected, 1e-6);
+	if (code > 0) {
+	    CHECK(colors[code][0] > colors[code - 1][0]);
+	}
+    }
+}
+
+int main() {
+    test_half_round_trip();
+    test_half_rounding();
+    test_half_stochastic_rounding();
+    test_tone_tables();
+    test_tone_special_values();
+    test_tone_exposure_and_curve();
+    test_srgb_decoding();
+    return check_result();
+}
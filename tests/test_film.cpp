@@ -0,0 +1,112 @@
+#include <sstream>
+#include <vector>
+
+#include "Image.hpp"
+#include "check.hpp"
+
+// Merges one tile per sample, the way the renderer merges single-sample passes
+static void add_samples(RGBFilm& film, float value, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+	RGBFilmTile tile = film.make_tile(0, film.height(), 0, film.width());
+	tile.add_sample(Vec2(1.5f, 1.5f), std::vector<RGBColor>(1, RGBColor::gray(value)));
+	film.merge_tile(tile);
+    }
+}
+
+static void check_same_colors(const RGBFilm& a, const RGBFilm& b, float tolerance = 0.0f) {
+    Buffer2D<RGBColor> ca = a.get_colors(0);
+    Buffer2D<RGBColor> cb = b.get_colors(0);
+    for (size_t row = 0; row < ca.rows(); row++) {
+	for (size_t col = 0; col < ca.columns(); col++) {
+	    for (size_t c = 0; c < 3; c++) {
+		CHECK_NEAR(ca(row, col)[c], cb(row, col)[c], tolerance);
+	    }
+	}
+    }
+}
+
+// The mean keeps moving at high sample counts, in compact films too
+static void test_convergence() {
+    for (bool compact : {false, true}) {
+	RGBFilm film(4, 4, 1, Filter(), compact);
+	add_samples(film, 0.2f, 1000);
+	add_samples(film, 0.8f, 3096);
+
+	// the rounding noise of a compact film, under 2 half ulps on average
+	// per merge, grows as the square root of the merges
+	float expected = (1000 * 0.2f + 3096 * 0.8f) / 4096;
+	CHECK_NEAR(film.get_colors(0)(1, 1)[0], expected, compact ? 0.03 : 1e-4);
+    }
+}
+
+// Averaged over many pixels, the means of a compact film show no bias, at any
+// sample count : rounding them to nearest would stall them
+static void test_compact_unbiased() {
+    size_t size = 16;
+    RGBFilm film(size, size, 1, Filter(BOX, 0.5f), false);
+    RGBFilm compact(size, size, 1, Filter(BOX, 0.5f), true);
+    std::vector<RGBColor> color(1);
+
+    for (size_t sample = 0; sample < 8192; sample++) {
+	color[0] = RGBColor::gray(sample < 1000 ? 0.2f : 0.8f);
+	for (RGBFilm* f : {&film, &compact}) {
+	    RGBFilmTile tile = f->make_tile(0, size, 0, size);
+	    for (size_t row = 0; row < size; row++) {
+		for (size_t col = 0; col < size; col++) {
+		    tile.add_sample(Vec2(col + 0.5f, row + 0.5f), color);
+		}
+	    }
+	    f->merge_tile(tile);
+	}
+
+	if (sample == 1023 || sample == 4095 || sample == 8191) {
+	    Buffer2D<RGBColor> expected = film.get_colors(0);
+	    Buffer2D<RGBColor> colors = compact.get_colors(0);
+	    double error = 0.0;
+	    for (size_t row = 0; row < size; row++) {
+		for (size_t col = 0; col < size; col++) {
+		    CHECK_NEAR(colors(row, col)[1], expected(row, col)[1], 0.03);
+		    error += colors(row, col)[1] - expected(row, col)[1];
+		}
+	    }
+	    CHECK_NEAR(error / (size * size), 0.0, 2e-3);
+	}
+    }
+}
+
+static void test_write_read() {
+    for (bool compact : {false, true}) {
+	RGBFilm film(4, 4, 1, Filter(), compact);
+	add_samples(film, 0.7f, 10);
+
+	std::stringstream stream;
+	film.write(stream);
+	RGBFilm read(stream);
+	CHECK(read.compact() == compact);
+	check_same_colors(film, read);
+    }
+}
+
+static void test_merge() {
+    RGBFilm whole(4, 4, 1, Filter(), false);
+    add_samples(whole, 0.1f, 5);
+    add_samples(whole, 0.9f, 5);
+
+    RGBFilm first(4, 4, 1, Filter(), false);
+    RGBFilm second(4, 4, 1, Filter(), true);
+    add_samples(first, 0.1f, 5);
+    add_samples(second, 0.9f, 5);
+
+    // half means of colors under 1
+    first.merge(second);
+    CHECK(first.compact());
+    check_same_colors(whole, first, 1e-3f);
+}
+
+int main() {
+    test_convergence();
+    test_compact_unbiased();
+    test_write_read();
+    test_merge();
+    return check_result();
+}
@@ -0,0 +1,152 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include "Scene.hpp"
+#include "Sphere.hpp"
+#include "TriangleMesh.hpp"
+#include "check.hpp"
+
+// Traversal only records the closest hit, and Scene::ray_intersect computes
+// its attributes once, in the space of the shape hit : they must be those of
+// the closest shape, even when a farther one is traversed first
+
+static const float mesh_angle = 0.4f;
+static const Vec3 mesh_scale(2.0f, 1.5f, 1.0f);
+static const Vec3 mesh_offset(0.5f, 0.0f, -5.0f);
+
+// unit quad in the z = 0 plane, with tilted vertex normals, split by the
+// loader into the triangles (1, 2, 3) and (1, 3, 4)
+static const Vec3 quad_positions[] = {
+    Vec3(-1.0f, -1.0f, 0.0f), Vec3(1.0f, -1.0f, 0.0f), Vec3(1.0f, 1.0f, 0.0f), Vec3(-1.0f, 1.0f, 0.0f)
+};
+static const Vec3 quad_normals[] = {
+    Vec3(0.2f, 0.0f, 1.0f), Vec3(0.0f, 0.3f, 1.0f), Vec3(-0.1f, -0.1f, 1.0f), Vec3(0.1f, -0.2f, 1.0f)
+};
+
+static void write_quad(const std::string& path) {
+    std::ofstream out(path);
+    for (const Vec3& p : quad_positions) {
+	out << "v " << p[0] << " " << p[1] << " " << p[2] << "\n";
+    }
+    for (const Vec3& n : quad_normals) {
+	out << "vn " << n[0] << " " << n[1] << " " << n[2] << "\n";
+    }
+    out << "f 1//1 2//2 3//3 4//4\n";
+}
+
+static Transform mesh_transform() {
+    return Transform::translate(mesh_offset) * Transform::rotate(Vec3(0.0f, 0.0f, 1.0f), mesh_angle)
+	* Transform::scale(mesh_scale[0], mesh_scale[1], mesh_scale[2]);
+}
+
+// rotation of the mesh transform, about z
+static Vec3 rotate_z(const Vec3& v) {
+    float c = std::cos(mesh_angle);
+    float s = std::sin(mesh_angle);
+    return Vec3(c * v[0] - s * v[1], s * v[0] + c * v[1], v[2]);
+}
+
+static Vec3 mesh_point(const Vec3& p) {
+    return mesh_offset + rotate_z(Vec3(p[0] * mesh_scale[0], p[1] * mesh_scale[1], p[2] * mesh_scale[2]));
+}
+
+static Vec3 mesh_normal(const Vec3& n) {
+    return rotate_z(Vec3(n[0] / mesh_scale[0], n[1] / mesh_scale[1], n[2] / mesh_scale[2])).normalized();
+}
+
+static void check_near(const Vec3& a, const Vec3& b) {
+    for (size_t i = 0; i < 3; i++) {
+	CHECK_NEAR(a[i], b[i], 1e-4);
+    }
+}
+
+// the farther mesh is traversed first, the sphere in front of it is hit
+static void test_sphere_in_front() {
+    const std::string path = "test_hit_attributes.obj";
+    write_quad(path);
+    TriangleMesh quad(path);
+    std::remove(path.c_str());
+    Sphere ball(Vec3(0.1f, 0.0f, 0.0f), 0.5f);
+
+    Shape mesh_shape(&quad, nullptr);
+    mesh_shape.set_transform(mesh_transform());
+    Shape sphere_shape(&ball, nullptr);
+    sphere_shape.set_transform(Transform::translate(0.0f, 0.2f, -2.0f) * Transform::scale(1.5f));
+
+    Scene scene;
+    scene.add_shape(&mesh_shape);
+    scene.add_shape(&sphere_shape);
+
+    Ray ray(Vec3(0.2f, 0.1f, 3.0f), Vec3(0.01f, -0.02f, -1.0f));
+    CHECK(mesh_shape.ray_intersect(Ray(ray.o, ray.d)));
+    Intersect itx;
+    CHECK(scene.ray_intersect(ray, itx));
+    CHECK(itx.shape == &sphere_shape);
+
+    // the sphere of center (0.15, 0.2, -2) and radius 0.75 in the scene
+    Vec3 center(0.15f, 0.2f, -2.0f);
+    float radius = 0.75f;
+    Vec3 oc = ray.o - center;
+    float a = dot(ray.d, ray.d);
+    float b = dot(oc, ray.d);
+    float t = (-b - std::sqrt(b * b - a * (dot(oc, oc) - radius * radius))) / a;
+    Vec3 point = ray.o + t * ray.d;
+
+    CHECK_NEAR(ray.tmax, t, 1e-4);
+    check_near(itx.point, point);
+    check_near(itx.normal, (point - center) / radius);
+    check_near(itx.wo, (-ray.d).normalized());
+}
+
+// the farther sphere is traversed first, the mesh in front of it is hit
+static void test_mesh_in_front() {
+    const std::string path = "test_hit_attributes.obj";
+    write_quad(path);
+    TriangleMesh quad(path);
+    std::remove(path.c_str());
+    Sphere ball(Vec3(0.0f, 0.0f, 0.0f), 1.0f);
+
+    Shape mesh_shape(&quad, nullptr);
+    mesh_shape.set_transform(mesh_transform());
+    Shape sphere_shape(&ball, nullptr);
+    sphere_shape.set_transform(Transform::translate(0.2f, 0.0f, -2.0f) * Transform::scale(0.8f));
+
+    Scene scene;
+    scene.add_shape(&sphere_shape);
+    scene.add_shape(&mesh_shape);
+
+    Ray ray(Vec3(0.3f, -0.2f, -9.0f), Vec3(-0.02f, 0.03f, 1.0f));
+    CHECK(sphere_shape.ray_intersect(Ray(ray.o, ray.d)));
+    Intersect itx;
+    CHECK(scene.ray_intersect(ray, itx));
+    CHECK(itx.shape == &mesh_shape);
+
+    // the ray crosses the second triangle, (1, 3, 4), of the quad in the
+    // scene : solve o + t d = p1 + u (p3 - p1) + v (p4 - p1)
+    Vec3 p1 = mesh_point(quad_positions[0]);
+    Vec3 e1 = mesh_point(quad_positions[2]) - p1;
+    Vec3 e2 = mesh_point(quad_positions[3]) - p1;
+    Vec3 s = ray.o - p1;
+    float det = dot(cross(ray.d, e2), e1);
+    float u = dot(cross(ray.d, e2), s) / det;
+    float v = dot(cross(s, e1), ray.d) / det;
+    float t = dot(cross(s, e1), e2) / det;
+    Vec3 normal = (1.0f - u - v) * quad_normals[0] + u * quad_normals[2] + v * quad_normals[3];
+
+    CHECK(u > 0.0f && v > 0.0f && u + v < 1.0f);
+    CHECK(itx.primitive == 1);
+    CHECK_NEAR(itx.u, u, 1e-4);
+    CHECK_NEAR(itx.v, v, 1e-4);
+    CHECK_NEAR(ray.tmax, t, 1e-4);
+    check_near(itx.point, ray.o + t * ray.d);
+    check_near(itx.normal, mesh_normal(normal));
+    check_near(itx.wo, (-ray.d).normalized());
+}
+
+int main() {
+    test_sphere_in_front();
+    test_mesh_in_front();
+
+    return check_result();
+}
@@ -0,0 +1,181 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+#include "check.hpp"
+
+// noise in some rows, gradients and flat runs in the others, for every PNG
+// filter to be picked and matches to reach across the deflated blocks
+static Buffer2D<RGB8> test_image(size_t height, size_t width, std::mt19937& rng) {
+    Buffer2D<RGB8> image(height, width);
+    for (size_t row = 0; row < height; row++) {
+	for (size_t col = 0; col < width; col++) {
+	    uint8_t v = static_cast<uint8_t>(row + 3 * col);
+	    switch ((row / 7) % 3) {
+	    case 0:
+		image(row, col) = RGB8{static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()),
+				       static_cast<uint8_t>(rng())};
+		break;
+	    case 1:
+		image(row, col) = RGB8{v, static_cast<uint8_t>(255 - v), static_cast<uint8_t>(row)};
+		break;
+	    default:
+		image(row, col) = RGB8{40, 80, 120};
+	    }
+	}
+    }
+    return image;
+}
+
+static bool same_pixels(const Buffer2D<RGB8>& a, const Buffer2D<RGB8>& b) {
+    if (a.rows() != b.rows() || a.columns() != b.columns()) {
+	return false;
+    }
+    for (size_t row = 0; row < a.rows(); row++) {
+	for (size_t col = 0; col < a.columns(); col++) {
+	    if (a(row, col).packed() != b(row, col).packed()) {
+		return false;
+	    }
+	}
+    }
+    return true;
+}
+
+// the PNGs encoded in parallel, in one or many deflated blocks, decode to the
+// image written
+static void test_png_round_trip() {
+    const std::string path = "test_image_io.png";
+    const size_t sizes[][2] = {{1, 1}, {3, 7}, {64, 1}, {1000, 300}, {700, 1500}};
+    std::mt19937 rng(1);
+    for (size_t threads : {1, 4}) {
+	ThreadPool pool(threads);
+	for (const auto& size : sizes) {
+	    Buffer2D<RGB8> image = test_image(size[0], size[1], rng);
+	    {
+		std::ofstream out(path, std::ios::binary);
+		write_png(image, pool, out);
+	    }
+	    CHECK(same_pixels(read_png(path), image));
+	}
+    }
+    std::remove(path.c_str());
+}
+
+static Buffer2D<RGBColor> random_colors(size_t height, size_t width, std::mt19937& rng) {
+    std::lognormal_distribution<float> distribution(0.0f, 2.0f);
+    Buffer2D<RGBColor> colors(height, width);
+    for (size_t row = 0; row < height; row++) {
+	for (size_t col = 0; col < width; col++) {
+	    colors(row, col) = RGBColor(distribution(rng), -distribution(rng), 0.0f);
+	}
+    }
+    return colors;
+}
+
+// PFMs store the floats exactly
+static void test_pfm_round_trip() {
+    const std::string path = "test_image_io.pfm";
+    std::mt19937 rng(2);
+    Buffer2D<RGBColor> colors = random_colors(37, 53, rng);
+    {
+	std::ofstream out(path, std::ios::binary);
+	write_pfm(colors, out);
+    }
+    Buffer2D<RGBColor> read = read_pfm(path);
+    CHECK(read.rows() == colors.rows() && read.columns() == colors.columns());
+    for (size_t row = 0; row < colors.rows(); row++) {
+	for (size_t col = 0; col < colors.columns(); col++) {
+	    for (size_t c = 0; c < 3; c++) {
+		CHECK(read(row, col)[c] == colors(row, col)[c]);
+	    }
+	}
+    }
+    std::remove(path.c_str());
+}
+
+template<typename T>
+static T read_value(std::istream& in) {
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+// Reads back the uncompressed scanline OpenEXR files of write_exr : the
+// header attributes, the offset table, then checks the chunk of each line
+// against the halves of the layers
+static void test_exr_layout() {
+    std::mt19937 rng(3);
+    size_t width = 21;
+    size_t height = 35;
+    std::vector<std::string> names = {"L*E", "LDE"};
+    std::vector<Buffer2D<RGBColor>> layers = {random_colors(height, width, rng),
+					      random_colors(height, width, rng)};
+    ThreadPool pool(4);
+    std::stringstream file;
+    write_exr(names, layers, pool, file);
+
+    char magic[4];
+    file.read(magic, 4);
+    CHECK(std::memcmp(magic, "\x76\x2f\x31\x01", 4) == 0);
+    CHECK(read_value<int32_t>(file) == 2);
+
+    std::map<std::string, std::string> attributes;
+    std::string name;
+    while (std::getline(file, name, '\0') && !name.empty()) {
+	std::string type;
+	std::getline(file, type, '\0');
+	std::string value(read_value<int32_t>(file), '\0');
+	file.read(&value[0], value.size());
+	attributes[name] = value;
+    }
+    CHECK(attributes["compression"] == std::string(1, '\0'));
+    CHECK(attributes["lineOrder"] == std::string(1, '\0'));
+    int32_t window[4];
+    std::memcpy(window, attributes["dataWindow"].data(), sizeof(window));
+    CHECK(window[0] == 0 && window[1] == 0);
+    CHECK(window[2] == static_cast<int32_t>(width) - 1 && window[3] == static_cast<int32_t>(height) - 1);
+
+    // channels in alphabetical order, all halves
+    std::vector<std::string> channels;
+    std::stringstream channel_list(attributes["channels"]);
+    while (std::getline(channel_list, name, '\0') && !name.empty()) {
+	CHECK(read_value<int32_t>(channel_list) == 1);
+	channel_list.ignore(3 * sizeof(int32_t));
+	channels.push_back(name);
+    }
+    CHECK((channels == std::vector<std::string>{"L*E.B", "L*E.G", "L*E.R", "LDE.B", "LDE.G", "LDE.R"}));
+
+    std::vector<uint64_t> offsets(height);
+    for (uint64_t& offset : offsets) {
+	offset = read_value<uint64_t>(file);
+    }
+    for (size_t row = 0; row < height; row++) {
+	file.seekg(offsets[row]);
+	CHECK(read_value<int32_t>(file) == static_cast<int32_t>(row));
+	CHECK(read_value<int32_t>(file) == static_cast<int32_t>(channels.size() * width * sizeof(uint16_t)));
+	for (const std::string& channel : channels) {
+	    const Buffer2D<RGBColor>& layer = layers[channel.compare(0, 3, "LDE") == 0];
+	    char component = channel.back();
+	    for (size_t col = 0; col < width; col++) {
+		RGBHalf h(layer(row, col));
+		uint16_t expected = component == 'R' ? h.r : component == 'G' ? h.g : h.b;
+		CHECK(read_value<uint16_t>(file) == expected);
+	    }
+	}
+    }
+    CHECK(file.peek() == EOF);
+}
+
+int main() {
+    test_png_round_trip();
+    test_pfm_round_trip();
+    test_exr_layout();
+    return check_result();
+}
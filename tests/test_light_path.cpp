@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LightPathExpression.hpp"
+#include "check.hpp"
+
+static const SurfaceType path_types[] = {
+    SurfaceType::EYE, SurfaceType::DIFFUSE, SurfaceType::SPECULAR, SurfaceType::LIGHT
+};
+
+static std::vector<LightPathExpression> parse(const std::vector<std::string>& strings) {
+    std::vector<LightPathExpression> patterns;
+    for (const std::string& s : strings) {
+	patterns.push_back(LightPathExpression(s));
+    }
+    return patterns;
+}
+
+// the automaton agrees with match() on every path of up to max_length vertices
+static void test_automaton_matches(const std::vector<std::string>& strings, size_t max_length) {
+    std::vector<LightPathExpression> patterns = parse(strings);
+    LightPathAutomaton automaton(patterns);
+
+    for (SurfaceType type : path_types) {
+	CHECK(automaton.is_dead(automaton.step(LightPathAutomaton::DEAD, type)));
+    }
+
+    size_t path_count = 1;
+    for (size_t length = 0; length <= max_length; length++) {
+	for (size_t code = 0; code < path_count; code++) {
+	    // in tracing order, from the eye
+	    LightPathExpression path;
+	    LightPathAutomaton::State state = automaton.start();
+	    for (size_t i = 0, c = code; i < length; i++, c /= 4) {
+		path.push_back(path_types[c % 4]);
+		state = automaton.step(state, path_types[c % 4]);
+	    }
+
+	    LightPathExpression expr = path;
+	    expr.reverse();
+	    const std::vector<size_t>& matches = automaton.matches(state);
+	    for (size_t k = 0; k < patterns.size(); k++) {
+		bool automaton_match = std::find(matches.begin(), matches.end(), k) != matches.end();
+		if (automaton_match != match(patterns[k], expr)) {
+		    std::cerr << "path " << expr << ", expression " << patterns[k] << "\n";
+		    check_failures++;
+		}
+	    }
+	    CHECK(automaton.accepts(state) == !matches.empty());
+	}
+	path_count *= 4;
+    }
+}
+
+static void test_max_path_length() {
+    CHECK(LightPathAutomaton(parse({"LDE"})).max_path_length() == 3);
+    CHECK(LightPathAutomaton(parse({"LDE", "L.SDE"})).max_path_length() == 5);
+    CHECK(LightPathAutomaton(parse({"LDE", "LD*E"})).max_path_length() == SIZE_MAX);
+}
+
+int main() {
+    test_automaton_matches({"L*E", "LDE", "L.*DDE", "L*SD*E", "L.DE", "**L"}, 7);
+    test_automaton_matches({"LDDE", "LSE"}, 7);
+    test_automaton_matches({"..E"}, 6);
+    test_max_path_length();
+    return check_result();
+}
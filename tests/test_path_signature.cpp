@@ -0,0 +1,107 @@
+#include <random>
+#include <vector>
+
+#include "PathSignature.hpp"
+#include "check.hpp"
+
+static PathSignature random_signature(std::mt19937& rng, size_t length) {
+    PathSignature signature;
+    for (size_t i = 0; i < length; i++) {
+	signature.push_back(static_cast<SurfaceType>(rng() % 4));
+    }
+    return signature;
+}
+
+static void test_push_pop() {
+    std::mt19937 rng(1);
+    std::vector<SurfaceType> types;
+    PathSignature signature;
+    for (size_t i = 0; i < PathSignature::max_length; i++) {
+	types.push_back(static_cast<SurfaceType>(rng() % 4));
+	signature.push_back(types.back());
+    }
+    CHECK(signature.length() == PathSignature::max_length);
+    for (size_t i = 0; i < types.size(); i++) {
+	CHECK(signature[i] == types[i]);
+    }
+
+    // popping clears the bits, so equal paths have equal signatures
+    PathSignature prefix;
+    prefix.push_back(types[0]);
+    prefix.push_back(types[1]);
+    while (signature.length() > 2) {
+	signature.pop_back();
+    }
+    CHECK(signature == prefix);
+}
+
+static void test_reverse() {
+    std::mt19937 rng(2);
+    for (size_t length = 0; length <= PathSignature::max_length; length++) {
+	PathSignature signature = random_signature(rng, length);
+	PathSignature reversed = signature;
+	reversed.reverse();
+	CHECK(reversed.length() == length);
+	for (size_t i = 0; i < length; i++) {
+	    CHECK(reversed[i] == signature[length - 1 - i]);
+	}
+	reversed.reverse();
+	CHECK(reversed == signature);
+    }
+}
+
+static void test_key() {
+    std::mt19937 rng(3);
+    for (size_t length = 0; length < PathSignature::max_length; length++) {
+	for (int i = 0; i < 100; i++) {
+	    PathSignature signature = random_signature(rng, length);
+	    CHECK(PathSignature::from_key(signature.key()) == signature);
+	}
+    }
+
+    // paths of only EYE vertices differ by their length alone
+    PathSignature a;
+    PathSignature b;
+    b.push_back(SurfaceType::EYE);
+    CHECK(a != b);
+    CHECK(a.bits() == b.bits());
+    CHECK(a.key() != b.key());
+    CHECK(a < b);
+}
+
+static void test_expression_conversion() {
+    LightPathExpression expr("LSDDE");
+    PathSignature signature = to_signature(expr);
+    CHECK(signature.length() == 5);
+    CHECK(signature[0] == SurfaceType::EYE);
+    CHECK(signature[4] == SurfaceType::LIGHT);
+
+    LightPathExpression back = to_expression(signature);
+    CHECK(back.length() == expr.length());
+    for (size_t i = 0; i < expr.length(); i++) {
+	CHECK(back[i] == expr[i]);
+    }
+}
+
+// running the automaton on a signature is the same as stepping through it
+static void test_automaton_run() {
+    LightPathAutomaton automaton({LightPathExpression("L*E"), LightPathExpression("LD*SE")});
+    std::mt19937 rng(4);
+    for (int i = 0; i < 1000; i++) {
+	PathSignature signature = random_signature(rng, rng() % 8);
+	LightPathAutomaton::State state = automaton.start();
+	for (size_t k = 0; k < signature.length(); k++) {
+	    state = automaton.step(state, signature[k]);
+	}
+	CHECK(automaton.run(signature) == state);
+    }
+}
+
+int main() {
+    test_push_pop();
+    test_reverse();
+    test_key();
+    test_expression_conversion();
+    test_automaton_run();
+    return check_result();
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "Image.hpp"
+#include "check.hpp"
+
+// two-pass mean and sum of squared differences, in double precision
+static void reference_stats(const std::vector<float>& xs, double* mean, double* m2) {
+    double sum = 0.0;
+    for (float x : xs) {
+	sum += x;
+    }
+    *mean = sum / xs.size();
+    *m2 = 0.0;
+    for (float x : xs) {
+	*m2 += (x - *mean) * (x - *mean);
+    }
+}
+
+static std::vector<float> random_samples(std::mt19937& rng, size_t count) {
+    // heavy tailed, like the luminances of a noisy pixel
+    std::lognormal_distribution<float> distribution(0.0f, 1.0f);
+    std::vector<float> xs(count);
+    for (float& x : xs) {
+	x = distribution(rng);
+    }
+    return xs;
+}
+
+static void test_add() {
+    std::mt19937 rng(1);
+    std::vector<float> xs = random_samples(rng, 10000);
+    PixelStats stats;
+    for (float x : xs) {
+	stats.add(x);
+    }
+
+    double mean, m2;
+    reference_stats(xs, &mean, &m2);
+    CHECK(stats.count == xs.size());
+    CHECK_NEAR(stats.mean, mean, 1e-4 * mean);
+    CHECK_NEAR(stats.m2, m2, 1e-3 * m2);
+}
+
+// merging the statistics of the parts of a sample set, in any grouping, gives
+// the statistics of the whole set
+static void test_merge() {
+    std::mt19937 rng(2);
+    for (int it = 0; it < 100; it++) {
+	std::vector<float> xs = random_samples(rng, 1 + rng() % 2000);
+
+	std::vector<PixelStats> parts;
+	for (size_t i = 0; i < xs.size(); ) {
+	    size_t end = std::min(xs.size(), i + 1 + rng() % 100);
+	    parts.push_back(PixelStats());
+	    for (; i < end; i++) {
+		parts.back().add(xs[i]);
+	    }
+	}
+	// an empty part on each side
+	parts.insert(parts.begin(), PixelStats());
+	parts.push_back(PixelStats());
+
+	// merge neighbours pairwise, as tiles are merged into the film
+	while (parts.size() > 1) {
+	    std::vector<PixelStats> merged;
+	    for (size_t i = 0; i < parts.size(); i += 2) {
+		merged.push_back(parts[i]);
+		if (i + 1 < parts.size()) {
+		    merged.back().merge(parts[i + 1]);
+		}
+	    }
+	    parts.swap(merged);
+	}
+
+	double mean, m2;
+	reference_stats(xs, &mean, &m2);
+	CHECK(parts[0].count == xs.size());
+	CHECK_NEAR(parts[0].mean, mean, 1e-4 * mean);
+	CHECK_NEAR(parts[0].m2, m2, 1e-3 * m2 + 1e-6);
+    }
+}
+
+static void test_relative_error() {
+    PixelStats stats;
+    CHECK(stats.relative_error() == std::numeric_limits<float>::infinity());
+    stats.add(1.0f);
+    CHECK(stats.relative_error() == std::numeric_limits<float>::infinity());
+
+    // mean 2, sample variance 6 / 5
+    stats = PixelStats();
+    stats.add(1.0f);
+    stats.add(1.0f);
+    stats.add(4.0f);
+    stats.add(2.0f);
+    stats.add(2.0f);
+    stats.add(2.0f);
+    CHECK_NEAR(stats.mean, 2.0, 1e-6);
+    CHECK_NEAR(stats.relative_error(), std::sqrt(1.2 / 6.0) / 2.0, 1e-6);
+}
+
+int main() {
+    test_add();
+    test_merge();
+    test_relative_error();
+    return check_result();
+}
@@ -0,0 +1,54 @@
+#include <vector>
+
+#include "Sampling.hpp"
+#include "check.hpp"
+
+static std::vector<float> draw(uint64_t stream, size_t count) {
+    seed_random_stream(stream);
+    std::vector<float> xs(count);
+    for (float& x : xs) {
+	x = random_01();
+    }
+    return xs;
+}
+
+// a stream restarts from the same numbers, whatever was drawn before
+static void test_streams_repeat() {
+    std::vector<float> a = draw(42, 100);
+    draw(43, 1000);
+    CHECK(draw(42, 100) == a);
+    CHECK(draw(43, 100) != a);
+}
+
+// the first numbers of consecutive streams, as used by neighbouring pixels,
+// are uniform and uncorrelated
+static void test_stream_starts() {
+    const size_t stream_count = 100000;
+    const size_t bins = 16;
+    std::vector<size_t> histogram(bins, 0);
+    double sum = 0.0;
+    double products = 0.0;
+    float previous = 0.5f;
+    for (size_t stream = 0; stream < stream_count; stream++) {
+	float x = draw(stream, 1)[0];
+	CHECK(x >= 0.0f && x < 1.0f);
+	histogram[static_cast<size_t>(x * bins)]++;
+	sum += x;
+	products += (x - 0.5) * (previous - 0.5);
+	previous = x;
+    }
+
+    CHECK_NEAR(sum / stream_count, 0.5, 0.005);
+    // correlation of consecutive streams, 1/12 being the variance
+    CHECK_NEAR(products / stream_count * 12.0, 0.0, 0.02);
+    for (size_t count : histogram) {
+	CHECK_NEAR(count, stream_count / bins, stream_count / bins * 0.05);
+    }
+}
+
+int main() {
+    initialize_random_system(1);
+    test_streams_repeat();
+    test_stream_starts();
+    return check_result();
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "TileScheduler.hpp"
+#include "check.hpp"
+
+// number of tiles covering each pixel
+static std::vector<int> coverage(const std::vector<Tile>& tiles, size_t width, size_t height) {
+    std::vector<int> counts(width * height, 0);
+    for (const Tile& tile : tiles) {
+	for (size_t row = tile.rowmin; row < tile.rowmax; row++) {
+	    for (size_t col = tile.colmin; col < tile.colmax; col++) {
+		counts[row * width + col]++;
+	    }
+	}
+    }
+    return counts;
+}
+
+static void test_make_tiles() {
+    const size_t sizes[][3] = {{64, 64, 16}, {100, 37, 16}, {5, 300, 32}, {1, 1, 8}};
+    for (const auto& size : sizes) {
+	std::vector<Tile> tiles = make_tiles(size[0], size[1], size[2]);
+	std::vector<int> counts = coverage(tiles, size[0], size[1]);
+	CHECK(std::count(counts.begin(), counts.end(), 1) == static_cast<long>(counts.size()));
+    }
+}
+
+static void test_clip_tiles() {
+    size_t width = 100;
+    size_t height = 80;
+    std::vector<Tile> regions = {{5, 20, 3, 50}, {40, 41, 90, 100}, {10, 30, 40, 60}};
+    std::vector<Tile> tiles = clip_tiles(make_tiles(width, height, 16), regions);
+
+    // the pixels of the regions are covered once, the others at most once
+    std::vector<int> counts = coverage(tiles, width, height);
+    std::vector<int> in_region = coverage(regions, width, height);
+    for (size_t i = 0; i < counts.size(); i++) {
+	CHECK(counts[i] <= 1);
+	CHECK(in_region[i] == 0 || counts[i] == 1);
+    }
+}
+
+// the noise of a crop window averages over the pixels of the crop, not of the
+// whole image
+static void test_area_average() {
+    std::vector<Tile> tiles = clip_tiles(make_tiles(256, 192, 32), {{40, 56, 48, 64}});
+    CHECK(!tiles.empty());
+    CHECK_NEAR(area_average(tiles, std::vector<float>(tiles.size(), 0.1f)), 0.1, 1e-6);
+
+    // 2 tiles of 1 and 3 pixels
+    std::vector<Tile> unequal = {{0, 1, 0, 1}, {0, 1, 1, 4}};
+    CHECK_NEAR(area_average(unequal, {1.0f, 5.0f}), 4.0, 1e-6);
+    CHECK(area_average({}, {}) == 0.0f);
+}
+
+// film tiles whose aprons overlap are neighbours of each other
+static void test_neighbourhoods() {
+    size_t width = 100;
+    size_t height = 70;
+    size_t tile_size = 16;
+    size_t apron = tile_size / 2;
+    std::vector<Tile> tiles = make_tiles(width, height, tile_size);
+    tiles = clip_tiles(tiles, {{0, 70, 0, 30}, {50, 70, 30, 100}});
+    std::vector<std::vector<size_t>> neighbourhoods = tile_neighbourhoods(tiles, tile_size);
+
+    auto is_neighbour = [&](size_t i, size_t j) {
+	return std::binary_search(neighbourhoods[i].begin(), neighbourhoods[i].end(), j);
+    };
+    for (size_t i = 0; i < tiles.size(); i++) {
+	CHECK(std::is_sorted(neighbourhoods[i].begin(), neighbourhoods[i].end()));
+	CHECK(is_neighbour(i, i));
+	for (size_t j = 0; j < tiles.size(); j++) {
+	    CHECK(is_neighbour(i, j) == is_neighbour(j, i));
+
+	    bool overlap = tiles[i].rowmin < tiles[j].rowmax + 2 * apron
+		&& tiles[j].rowmin < tiles[i].rowmax + 2 * apron
+		&& tiles[i].colmin < tiles[j].colmax + 2 * apron
+		&& tiles[j].colmin < tiles[i].colmax + 2 * apron;
+	    CHECK(!overlap || is_neighbour(i, j));
+	}
+    }
+}
+
+// every (tile, pass) item is given out exactly once, whatever the number of
+// workers
+static void test_scheduler() {
+    const size_t configs[][3] = {{1, 5, 1}, {40, 7, 4}, {3, 9, 8}, {100, 1, 3}};
+    for (const auto& config : configs) {
+	size_t tile_count = config[0];
+	size_t pass_count = config[1];
+	size_t worker_count = config[2];
+	TileScheduler scheduler(tile_count, pass_count, worker_count);
+
+	std::vector<std::vector<size_t>> taken(worker_count);
+	std::vector<std::thread> workers;
+	for (size_t w = 0; w < worker_count; w++) {
+	    workers.push_back(std::thread([&, w]() {
+		size_t tile, pass;
+		while (scheduler.next(w, tile, pass)) {
+		    taken[w].push_back(pass * tile_count + tile);
+		}
+	    }));
+	}
+	for (std::thread& worker : workers) {
+	    worker.join();
+	}
+
+	std::vector<size_t> items;
+	for (const std::vector<size_t>& t : taken) {
+	    items.insert(items.end(), t.begin(), t.end());
+	}
+	std::sort(items.begin(), items.end());
+	CHECK(items.size() == tile_count * pass_count);
+	for (size_t i = 0; i < items.size(); i++) {
+	    CHECK(items[i] == i);
+	}
+    }
+}
+
+int main() {
+    test_make_tiles();
+    test_clip_tiles();
+    test_area_average();
+    test_neighbourhoods();
+    test_scheduler();
+    return check_result();
+}
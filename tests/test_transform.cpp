@@ -0,0 +1,98 @@
+#include <random>
+
+#include "Transform.hpp"
+#include "check.hpp"
+
+// The SSE versions of the Vec4 and Matrix4 operations must give the results
+// of the generic loops, bit for bit : these are the loops, written out
+
+static Matrix4 random_matrix(std::mt19937& rng) {
+    std::uniform_real_distribution<float> coordinate(-10.0f, 10.0f);
+    Matrix4 m;
+    for (size_t i = 0; i < 4; i++) {
+	for (size_t j = 0; j < 4; j++) {
+	    m(i, j) = coordinate(rng);
+	}
+    }
+    return m;
+}
+
+static Vec4 random_vec(std::mt19937& rng) {
+    std::uniform_real_distribution<float> coordinate(-10.0f, 10.0f);
+    return Vec4(coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng));
+}
+
+static void test_matrix_products() {
+    std::mt19937 rng(1);
+    for (int it = 0; it < 1000; it++) {
+	Matrix4 a = random_matrix(rng);
+	Matrix4 b = random_matrix(rng);
+	Vec4 v = random_vec(rng);
+
+	Matrix4 ab = a * b;
+	Vec4 av = a * v;
+	Matrix4 at = a.transpose();
+	for (size_t i = 0; i < 4; i++) {
+	    float row_product = 0.0f;
+	    for (size_t k = 0; k < 4; k++) {
+		row_product += a(i, k) * v[k];
+	    }
+	    CHECK(av[i] == row_product);
+
+	    for (size_t j = 0; j < 4; j++) {
+		float product = 0.0f;
+		for (size_t k = 0; k < 4; k++) {
+		    product += a(i, k) * b(k, j);
+		}
+		CHECK(ab(i, j) == product);
+		CHECK(at(i, j) == a(j, i));
+	    }
+	}
+    }
+}
+
+static void test_vec_arithmetic() {
+    std::mt19937 rng(2);
+    for (int it = 0; it < 1000; it++) {
+	Vec4 u = random_vec(rng);
+	Vec4 v = random_vec(rng);
+	float s = random_vec(rng)[0];
+
+	Vec4 sum = u + v;
+	Vec4 difference = u - v;
+	Vec4 scaled = u * s;
+	Vec4 divided = u / s;
+	float product = 0.0f;
+	for (size_t i = 0; i < 4; i++) {
+	    CHECK(sum[i] == u[i] + v[i]);
+	    CHECK(difference[i] == u[i] - v[i]);
+	    CHECK(scaled[i] == u[i] * s);
+	    CHECK(divided[i] == u[i] / s);
+	    product += u[i] * v[i];
+	}
+	CHECK(dot(u, v) == product);
+    }
+}
+
+// transforms and their inverses undo each other
+static void test_transforms() {
+    Transform t = Transform::translate(1.0f, 2.0f, 3.0f) * Transform::rotate(Vec3(0.0f, 0.0f, 1.0f), 0.3f)
+	* Transform::scale(2.0f);
+    Vec3 p(0.5f, -1.0f, 4.0f);
+    Vec3 q = transform_point(t.inverse(), transform_point(t, p));
+    for (size_t i = 0; i < 3; i++) {
+	CHECK_NEAR(q[i], p[i], 1e-5);
+    }
+
+    // normals stay orthogonal to the transformed tangents
+    Vec3 n(0.0f, 0.0f, 1.0f);
+    Vec3 tangent(1.0f, 1.0f, 0.0f);
+    CHECK_NEAR(dot(transform_normal(t, n), transform_vector(t, tangent)), 0.0, 1e-5);
+}
+
+int main() {
+    test_matrix_products();
+    test_vec_arithmetic();
+    test_transforms();
+    return check_result();
+}